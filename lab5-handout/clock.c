@@ -71,6 +71,54 @@ double get_counter()
 }
 /* $end x86cyclecounter */
 
+#elif defined(__x86_64__)
+/*********************************************************
+ * x86-64 versions of start_counter() and get_counter()
+ *********************************************************/
+
+/* Initialize the cycle counter */
+static unsigned cyc_hi = 0;
+static unsigned cyc_lo = 0;
+
+
+/* Set *hi and *lo to the high and low order bits  of the cycle counter.
+   rdtsc zero-extends into rdx:rax, so we just take the low halves. */
+void access_counter(unsigned *hi, unsigned *lo)
+{
+    unsigned h, l;
+
+    asm volatile("rdtsc" : "=d" (h), "=a" (l));
+    *hi = h;
+    *lo = l;
+}
+
+/* Record the current value of the cycle counter. */
+void start_counter()
+{
+    access_counter(&cyc_hi, &cyc_lo);
+}
+
+/* Return the number of cycles since the last call to start_counter. */
+double get_counter()
+{
+    unsigned ncyc_hi, ncyc_lo;
+    unsigned hi, lo, borrow;
+    double result;
+
+    /* Get cycle counter */
+    access_counter(&ncyc_hi, &ncyc_lo);
+
+    /* Do double precision subtraction */
+    lo = ncyc_lo - cyc_lo;
+    borrow = lo > ncyc_lo;
+    hi = ncyc_hi - cyc_hi - borrow;
+    result = (double) hi * (1 << 30) * 4 + lo;
+    if (result < 0) {
+	fprintf(stderr, "Error: counter returns neg value: %.0f\n", result);
+    }
+    return result;
+}
+
 #elif defined(__alpha)
 
 /****************************************************
@@ -136,27 +184,32 @@ double get_counter()
 #else
 
 /****************************************************************
- * All the other platforms for which we haven't implemented cycle
- * counter routines. Newer models of sparcs (v8plus) have cycle
- * counters that can be accessed from user programs, but since there
- * are still many sparc boxes out there that don't support this, we
- * haven't provided a Sparc version here.
+ * All the other platforms: no cycle counter routines, so the
+ * "counter" is read_counter's clock_gettime fallback and counts
+ * nanoseconds (mhz() then reports 1000).
  ***************************************************************/
 
+static unsigned long long cyc_start = 0;
+
+/* Set *hi and *lo to the high and low order bits of the counter */
+void access_counter(unsigned *hi, unsigned *lo)
+{
+    unsigned long long now = read_counter();
+
+    *hi = (unsigned)(now >> 32);
+    *lo = (unsigned)now;
+}
+
+/* Record the current value of the counter. */
 void start_counter()
 {
-    printf("ERROR: You are trying to use a start_counter routine in clock.c\n");
-    printf("that has not been implemented yet on this platform.\n");
-    printf("Please choose another timing package in config.h.\n");
-    exit(1);
+    cyc_start = read_counter();
 }
 
+/* Return the counts since the last call to start_counter. */
 double get_counter() 
 {
-    printf("ERROR: You are trying to use a get_counter routine in clock.c\n");
-    printf("that has not been implemented yet on this platform.\n");
-    printf("Please choose another timing package in config.h.\n");
-    exit(1);
+    return (double)(read_counter() - cyc_start);
 }
 #endif
 
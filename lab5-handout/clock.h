@@ -1,4 +1,34 @@
 /* Routines for using cycle counter */
+#ifndef __CLOCK_H_
+#define __CLOCK_H_
+
+#include <time.h>
+
+/* Read the cycle counter as one number: rdtsc on x86, elsewhere
+   CLOCK_MONOTONIC in nanoseconds. Inline, so that it can time every
+   single allocator operation */
+static inline unsigned long long read_counter(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/* What read_counter counts, for labeling its readings. The TSC ticks
+   at a fixed rate, which is not the core's current clock */
+#if defined(__x86_64__) || defined(__i386__)
+#define COUNTER_UNIT "ticks"
+#else
+#define COUNTER_UNIT "ns"
+#endif
+
+/* Read the raw cycle counter (read_counter split in two halves) */
+void access_counter(unsigned *hi, unsigned *lo);
 
 /* Start the counter */
 void start_counter();
@@ -20,3 +50,5 @@ double mhz_full(int verbose, int sleeptime);
 void start_comp_counter();
 
 double get_comp_counter();
+
+#endif /* __CLOCK_H_ */
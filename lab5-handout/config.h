@@ -29,7 +29,9 @@
   "coalescing-bal.rep",\
   "random-bal.rep",\
   "random2-bal.rep",\
-  "binary-bal.rep"
+  "binary-bal.rep",\
+  "realloc-bal.rep",\
+  "realloc2-bal.rep"
 
 
 
@@ -56,7 +58,7 @@
 #define ALIGNMENT 16
 
 /*
- * Maximum heap size in bytes
+ * Default maximum heap size in bytes (mdriver -m overrides it)
  */
 #define MAX_HEAP (20*(1<<20))  /* 20 MB */
 
@@ -65,6 +67,7 @@
  *****************************************************************************/
 #define USE_FCYC   0   /* cycle counter w/K-best scheme (x86 & Alpha only) */
 #define USE_ITIMER 0   /* interval timer (any Unix box) */
-#define USE_GETTOD 1   /* gettimeofday (any Unix box) */
+#define USE_GETTOD 0   /* gettimeofday (any Unix box) */
+#define USE_STATS  1   /* CLOCK_MONOTONIC_RAW, adaptive sampling to a 95% CI (Linux) */
 
 #endif /* __CONFIG_H */
@@ -8,6 +8,8 @@
  * the time in CPU cycles for a function f.
  */
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <sys/times.h>
 #include <stdio.h>
 
@@ -20,8 +22,9 @@
 #define EPSILON 0.01         /* K samples should be EPSILON of each other*/
 #define COMPENSATE 0         /* 1-> try to compensate for clock ticks */
 #define CLEAR_CACHE 0        /* Clear cache before running test function */
-#define CACHE_BYTES (1<<19)  /* Max cache size in bytes */
-#define CACHE_BLOCK 32       /* Cache block size in bytes */
+#define CACHE_BYTES 0        /* Bytes to sweep when clearing; 0 -> 2x the LLC */
+#define CACHE_BLOCK 0        /* Cache block size in bytes; 0 -> detect */
+#define LLC_GUESS (8<<20)    /* LLC size if it cannot be detected */
 
 static int kbest = K;
 static int maxsamples = MAXSAMPLES;
@@ -97,6 +100,64 @@ static int has_converged()
 	((1 + epsilon)*values[0] >= values[kbest-1]);
 }
 
+/*
+ * sysfs_llc_size - Size of the largest cache listed for cpu0 in sysfs,
+ *     for systems where sysconf does not know it. Returns 0 if none.
+ */
+static long sysfs_llc_size()
+{
+    char path[64];
+    FILE *fp;
+    long size, best = 0;
+    char unit;
+    int i;
+
+    for (i = 0; i < 10; i++) {
+	sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/size", i);
+	if ((fp = fopen(path, "r")) == NULL)
+	    break;
+	unit = 0;
+	if (fscanf(fp, "%ld%c", &size, &unit) >= 1) {
+	    if (unit == 'K')
+		size <<= 10;
+	    else if (unit == 'M')
+		size <<= 20;
+	    if (size > best)
+		best = size;
+	}
+	fclose(fp);
+    }
+    return best;
+}
+
+/*
+ * fcyc_llc_size - Size in bytes of the last-level cache, from sysconf,
+ *     then sysfs, then a conservative guess
+ */
+long fcyc_llc_size()
+{
+    long size = 0;
+
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (size <= 0)
+	size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+    if (size <= 0)
+	size = sysfs_llc_size();
+    return (size > 0) ? size : LLC_GUESS;
+}
+
+/*
+ * fcyc_flush_size - Number of bytes swept by each cache clear. Twice the
+ *     LLC, so that replacement policies that are not pure LRU still
+ *     lose all the test function's lines.
+ */
+long fcyc_flush_size()
+{
+    return cache_bytes ? cache_bytes : 2 * fcyc_llc_size();
+}
+
 /* 
  * clear - Code to clear cache 
  */
@@ -106,13 +167,25 @@ static void clear()
 {
     int x = sink;
     int *cptr, *cend;
-    int incr = cache_block/sizeof(int);
+    int incr;
+    if (!cache_block) {
+#ifdef _SC_LEVEL1_DCACHE_LINESIZE
+	cache_block = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+#endif
+	if (cache_block <= 0)
+	    cache_block = 64;
+    }
+    incr = cache_block/sizeof(int);
+    if (!cache_bytes)
+	cache_bytes = fcyc_flush_size();
     if (!cache_buf) {
 	cache_buf = malloc(cache_bytes);
 	if (!cache_buf) {
 	    fprintf(stderr, "Fatal error.  Malloc returned null when trying to clear cache\n");
 	    exit(1);
 	}
+	/* Give every page its own frame; untouched pages all alias the zero page */
+	memset(cache_buf, 1, cache_bytes);
     }
     cptr = (int *) cache_buf;
     cend = cptr + cache_bytes/sizeof(int);
@@ -123,6 +196,15 @@ static void clear()
     sink = x;
 }
 
+/*
+ * fcyc_flush_cache - Evict the caller's data from the cache hierarchy
+ *     by sweeping a buffer larger than the LLC
+ */
+void fcyc_flush_cache()
+{
+    clear();
+}
+
 /*
  * fcyc - Use K-best scheme to estimate the running time of function f
  */
@@ -184,7 +266,7 @@ void set_fcyc_clear_cache(int clear)
 
 /* 
  * set_fcyc_cache_size - Set size of cache to use when clearing cache 
- *     Default = 1<<19 (512KB)
+ *     Default = 0 (twice the detected LLC size)
  */
 void set_fcyc_cache_size(int bytes)
 {
@@ -199,7 +281,7 @@ void set_fcyc_cache_size(int bytes)
 
 /* 
  * set_fcyc_cache_block - Set size of cache block 
- *     Default = 32
+ *     Default = 0 (the detected L1 line size)
  */
 void set_fcyc_cache_block(int bytes) {
     cache_block = bytes;
@@ -13,6 +13,16 @@ typedef void (*test_funct)(void *);
 /* Compute number of cycles used by test function f */
 double fcyc(test_funct f, void* argp);
 
+/* Evict everything from the caches by sweeping a buffer of
+   fcyc_flush_size() bytes */
+void fcyc_flush_cache(void);
+
+/* Detected size of the last-level cache in bytes */
+long fcyc_llc_size(void);
+
+/* Bytes swept by fcyc_flush_cache (twice the LLC unless overridden) */
+long fcyc_flush_size(void);
+
 /*********************************************************
  * Set the various parameters used by measurement routines 
  *********************************************************/
@@ -26,13 +36,13 @@ void set_fcyc_clear_cache(int clear);
 
 /* 
  * set_fcyc_cache_size - Set size of cache to use when clearing cache 
- *     Default = 1<<19 (512KB)
+ *     Default = 0 (twice the detected LLC size)
  */
 void set_fcyc_cache_size(int bytes);
 
 /* 
  * set_fcyc_cache_block - Set size of cache block 
- *     Default = 32
+ *     Default = 0 (the detected L1 line size)
  */
 void set_fcyc_cache_block(int bytes);
 
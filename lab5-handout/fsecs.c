@@ -9,6 +9,7 @@
 #include "config.h"
 
 static double Mhz;  /* estimated CPU clock frequency */
+static ftimer_stats_t last; /* sample statistics of the last fsecs call */
 
 extern int verbose; /* -v option in mdriver.c */
 
@@ -36,6 +37,9 @@ void init_fsecs(void)
 #elif USE_GETTOD
     if (verbose)
 	printf("Measuring performance with gettimeofday().\n");
+#elif USE_STATS
+    if (verbose)
+	printf("Measuring performance with CLOCK_MONOTONIC_RAW (median of adaptive samples).\n");
 #endif
 }
 
@@ -44,14 +48,52 @@ void init_fsecs(void)
  */
 double fsecs(fsecs_test_funct f, void *argp) 
 {
+#if USE_STATS
+    return ftimer_stat(f, argp, &last);
+#else
+    double secs;
+
 #if USE_FCYC
     double cycles = fcyc(f, argp);
-    return cycles/(Mhz*1e6);
+    secs = cycles/(Mhz*1e6);
 #elif USE_ITIMER
-    return ftimer_itimer(f, argp, 10);
+    secs = ftimer_itimer(f, argp, 10);
 #elif USE_GETTOD
-    return ftimer_gettod(f, argp, 10);
+    secs = ftimer_gettod(f, argp, 10);
 #endif 
+
+    /* the other timers only give us one (averaged) number */
+    last.median = last.min = last.ci_lo = last.ci_hi = secs;
+    last.samples = 1;
+    last.reps = 1;
+    return secs;
+#endif
+}
+
+/*
+ * fsecs_cold - Switch between warm-cache (default) and cold-cache timing.
+ *    Only the cycle counter and ftimer_stat time runs one at a time, so
+ *    the averaging timers cannot flush between runs.
+ */
+int fsecs_cold(int cold)
+{
+#if USE_FCYC
+    set_fcyc_clear_cache(cold);
+    return 1;
+#elif USE_STATS
+    set_ftimer_prepare(cold ? fcyc_flush_cache : NULL);
+    return 1;
+#else
+    return !cold;
+#endif
+}
+
+/*
+ * fsecs_stats - Return the sample statistics of the last fsecs call
+ */
+void fsecs_stats(ftimer_stats_t *st)
+{
+    *st = last;
 }
 
 
@@ -1,4 +1,19 @@
+#ifndef __FSECS_H_
+#define __FSECS_H_
+
+#include "ftimer.h"
+
 typedef void (*fsecs_test_funct)(void *);
 
 void init_fsecs(void);
 double fsecs(fsecs_test_funct f, void *argp);
+
+/* Sample statistics of the last fsecs call. Timers that only produce an
+   average report it as the median and min, with an empty interval */
+void fsecs_stats(ftimer_stats_t *st);
+
+/* When cold is set, flush the caches before every timed run so that fsecs
+   reports cold-cache times. Returns 0 if the timer cannot do this */
+int fsecs_cold(int cold);
+
+#endif /* __FSECS_H_ */
@@ -7,11 +7,32 @@
  * Function timers that estimate the running time (in seconds) of a function f.
  *    ftimer_itimer: version that uses the interval timer
  *    ftimer_gettod: version that uses gettimeofday
+ *    ftimer_stat:   version that samples until the median is stable
  */
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <sched.h>
+#include <time.h>
 #include <sys/time.h>
 #include "ftimer.h"
 
+/* Default values for ftimer_stat */
+#define EPSILON 0.01        /* CI half-width relative to the median */
+#define WARMUP 2            /* untimed runs before sampling */
+#define MIN_SAMPLES 10      /* never stop before this many samples */
+#define MAX_SAMPLES 500     /* give up on convergence after this many */
+#define BUDGET 1.0          /* ...or after this many seconds */
+#define MIN_SAMPLE_SECS 1e-4 /* batch runs so a sample is at least this long */
+
+static double epsilon = EPSILON;
+static int warmup = WARMUP;
+static int min_samples = MIN_SAMPLES;
+static int max_samples = MAX_SAMPLES;
+static double budget = BUDGET;
+static ftimer_prep_funct prepare = NULL;
+
 /* function prototypes */
 static void init_etime(void);
 static double get_etime(void);
@@ -52,6 +73,148 @@ double ftimer_gettod(ftimer_test_funct f, void *argp, int n)
     return (1E-3*diff);
 }
 
+/*
+ * ftimer_now - seconds on the raw monotonic clock (not slewed by NTP)
+ */
+double ftimer_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+/*
+ * cmp_double - qsort comparison for doubles
+ */
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * median_ci - median of the n sorted values in v and a distribution-free
+ *    95% confidence interval for it (order statistics n/2 -+ 0.98 sqrt(n))
+ */
+static double median_ci(double *v, int n, double *lo, double *hi)
+{
+    int j, k;
+    double med;
+
+    med = (n % 2) ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+    j = (int)floor(n / 2.0 - 0.98 * sqrt(n));
+    k = (int)ceil(n / 2.0 + 0.98 * sqrt(n));
+    *lo = v[(j < 0) ? 0 : j];
+    *hi = v[(k > n - 1) ? n - 1 : k];
+    return med;
+}
+
+/*
+ * ftimer_stat - Sample the running time of f(argp) until the median is
+ * known to within epsilon. Return the median time of one run.
+ */
+double ftimer_stat(ftimer_test_funct f, void *argp, ftimer_stats_t *st)
+{
+    double *samples, *sorted;
+    double start, t, deadline, med = 0, lo = 0, hi = 0;
+    int i, n, reps;
+
+    if ((samples = malloc(2 * max_samples * sizeof(double))) == NULL) {
+        fprintf(stderr, "Fatal error.  Malloc failed in ftimer_stat\n");
+        exit(1);
+    }
+    sorted = samples + max_samples;
+
+    /* Warm up caches, branch predictors and page tables; time the last run */
+    t = 0;
+    for (i = 0; i < warmup || i == 0; i++) {
+        if (prepare)
+            prepare();
+        start = ftimer_now();
+        f(argp);
+        t = ftimer_now() - start;
+    }
+
+    /* Very short runs are batched so that clock overhead does not dominate,
+       unless each run has to be prepared separately */
+    reps = (t > 0 && t < MIN_SAMPLE_SECS) ? (int)ceil(MIN_SAMPLE_SECS / t) : 1;
+    if (prepare)
+        reps = 1;
+
+    deadline = ftimer_now() + budget;
+    for (n = 0; n < max_samples; ) {
+        if (prepare)
+            prepare();
+        start = ftimer_now();
+        for (i = 0; i < reps; i++)
+            f(argp);
+        samples[n++] = (ftimer_now() - start) / reps;
+
+        if (n < min_samples)
+            continue;
+
+        for (i = 0; i < n; i++)
+            sorted[i] = samples[i];
+        qsort(sorted, n, sizeof(double), cmp_double);
+        med = median_ci(sorted, n, &lo, &hi);
+        if (hi - lo <= 2 * epsilon * med || ftimer_now() > deadline)
+            break;
+    }
+
+    if (st != NULL) {
+        st->median = med;
+        st->min = sorted[0];
+        st->ci_lo = lo;
+        st->ci_hi = hi;
+        st->samples = n;
+        st->reps = reps;
+    }
+    free(samples);
+    return med;
+}
+
+/*
+ * Parameters of ftimer_stat
+ */
+void set_ftimer_epsilon(double epsilon_arg)
+{
+    epsilon = epsilon_arg;
+}
+
+void set_ftimer_warmup(int runs)
+{
+    warmup = runs;
+}
+
+void set_ftimer_samples(int min, int max)
+{
+    min_samples = (min < 1) ? 1 : min;
+    max_samples = (max < min_samples) ? min_samples : max;
+}
+
+void set_ftimer_budget(double secs)
+{
+    budget = secs;
+}
+
+void set_ftimer_prepare(ftimer_prep_funct prep)
+{
+    prepare = prep;
+}
+
+/*
+ * ftimer_pin_cpu - bind the calling process to one CPU so that samples
+ * are not spread over cores with different cache and frequency states
+ */
+int ftimer_pin_cpu(int cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set);
+}
 
 /*
  * Routines for manipulating the Unix interval timer
@@ -1,7 +1,21 @@
 /* 
  * Function timers 
  */
+#ifndef __FTIMER_H_
+#define __FTIMER_H_
+
 typedef void (*ftimer_test_funct)(void *); 
+typedef void (*ftimer_prep_funct)(void);
+
+/* Summary of the samples taken by ftimer_stat (all times in seconds) */
+typedef struct {
+    double median;   /* median time of one run of f */
+    double min;      /* fastest run */
+    double ci_lo;    /* 95% confidence interval of the median */
+    double ci_hi;
+    int samples;     /* number of samples taken */
+    int reps;        /* runs of f per sample */
+} ftimer_stats_t;
 
 /* Estimate the running time of f(argp) using the Unix interval timer.
    Return the average of n runs */
@@ -12,3 +26,26 @@ double ftimer_itimer(ftimer_test_funct f, void *argp, int n);
    Return the average of n runs */
 double ftimer_gettod(ftimer_test_funct f, void *argp, int n);
 
+/* Estimate the running time of f(argp) using CLOCK_MONOTONIC_RAW.
+   After a few warm-up runs, keep sampling until the 95% confidence
+   interval of the median is within epsilon of it (or the sample/time
+   budget runs out). Return the median and fill in *st if st != NULL */
+double ftimer_stat(ftimer_test_funct f, void *argp, ftimer_stats_t *st);
+
+/* Parameters of ftimer_stat */
+void set_ftimer_epsilon(double epsilon);   /* default 0.01 */
+void set_ftimer_warmup(int runs);          /* default 2 */
+void set_ftimer_samples(int min, int max); /* default 10, 500 */
+void set_ftimer_budget(double secs);       /* default 1.0 per call */
+
+/* If prep != NULL, ftimer_stat calls it (untimed) before every run of f
+   and times each run on its own, e.g. to flush the caches first */
+void set_ftimer_prepare(ftimer_prep_funct prep); /* default NULL */
+
+/* Current time in seconds on the raw monotonic clock */
+double ftimer_now(void);
+
+/* Pin the calling process to one CPU. Return 0 on success, -1 on error */
+int ftimer_pin_cpu(int cpu);
+
+#endif /* __FTIMER_H_ */
@@ -0,0 +1,556 @@
+/*
+ * gentrace.c - Synthetic trace generator for the malloc lab driver
+ *
+ * Produces a .rep trace file (the format read by mdriver's read_trace)
+ * from a parameterized workload model. The same seed and parameters
+ * always produce the same trace.
+ *
+ * Every allocated block gets a lifetime (in ops) when it is created and
+ * is kept in a min-heap ordered by time of death. The workload model
+ * decides, at each step, whether the next op allocates or frees; frees
+ * always release the block that is due to die first. At the end all
+ * remaining blocks are freed, so the traces are balanced like the
+ * handout's *-bal.rep traces.
+ *
+ * Models (-w):
+ *   steady    allocate unless some block has reached its time of death
+ *   ramp      live set grows for the first half of the trace and shrinks
+ *             during the second half
+ *   prodcons  producer/consumer: bursts of allocations followed by bursts
+ *             of frees in allocation (FIFO) order
+ *
+ * Orthogonal knobs: -p splits the trace into phases that each scale the
+ * request sizes by their own factor, and -r turns a fraction of the
+ * allocations into realloc growth chains on a live block.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+/* Misc */
+#define MAXCLASSES  64    /* max number of fixed size classes */
+#define MAXSIZE     ((size_t)1 << 48) /* sizes are clamped to this */
+#define MAXCHAIN    32    /* max number of reallocs in a growth chain */
+
+/* Characterizes a single trace operation */
+typedef struct {
+    char type;   /* 'a', 'f' or 'r' */
+    long index;  /* block id */
+    size_t size; /* byte size for 'a' and 'r' */
+} genop_t;
+
+/* Request size distribution */
+typedef struct {
+    enum {SZ_FIXED, SZ_UNIFORM, SZ_POWER, SZ_BIMODAL} kind;
+    double a, b, c;            /* parameters, see parse_sizes */
+    int nclasses;              /* SZ_FIXED only */
+    size_t classes[MAXCLASSES];
+} sizedist_t;
+
+/* Lifetime distribution, in ops */
+typedef struct {
+    enum {LT_FIXED, LT_UNIFORM, LT_EXP, LT_PARETO} kind;
+    double a, b;               /* parameters, see parse_lifetimes */
+} lifedist_t;
+
+/* A live block waiting in the death heap */
+typedef struct {
+    long death;  /* op number at which the block should be freed */
+    long id;     /* block id */
+} heapent_t;
+
+/********************
+ * Global variables
+ *******************/
+static unsigned long long rng_state;
+
+static genop_t *ops = NULL;    /* generated ops */
+static long num_ops = 0;
+static long max_ops = 0;
+
+static heapent_t *heap = NULL; /* min-heap of live blocks by death time */
+static long heap_n = 0;
+static long heap_max = 0;
+
+static size_t *block_size = NULL; /* current size of every block id */
+static long num_ids = 0;
+static long max_ids = 0;
+
+static size_t live_bytes = 0;  /* bytes currently allocated */
+static size_t peak_bytes = 0;  /* high water mark of live_bytes */
+
+/*********************
+ * Function prototypes
+ *********************/
+static double rng_uniform(void);
+static size_t sample_size(sizedist_t *d, double scale);
+static long sample_lifetime(lifedist_t *d);
+static void parse_sizes(char *spec, sizedist_t *d);
+static void parse_lifetimes(char *spec, lifedist_t *d);
+static void emit(char type, long index, size_t size);
+static void heap_push(long death, long id);
+static heapent_t heap_pop(void);
+static void write_trace(FILE *fp);
+static void usage(void);
+static void app_error(char *msg);
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv)
+{
+    int c, i;
+    long id;
+    char *outfile = NULL;
+    FILE *fp;
+    long t;                     /* number of ops generated so far */
+    long n = 10000;             /* target number of ops (-n) */
+    unsigned long long seed = 1;/* random seed (-s) */
+    char *model = "steady";     /* workload model (-w) */
+    int phases = 1;             /* number of phases (-p) */
+    double realloc_prob = 0.0;  /* fraction of allocs turned into reallocs (-r) */
+    int burst = 64;             /* max producer/consumer burst (-b) */
+    sizedist_t sizes;
+    lifedist_t lifetimes;
+    double *phase_scale;        /* size scale factor of every phase */
+    int phase;
+    long chain_id = -1;         /* block currently being grown by realloc */
+    int chain_left = 0;         /* reallocs left in the current chain */
+    int producing = 1;          /* prodcons: in a producer burst? */
+    int burst_left = 0;         /* prodcons: ops left in the current burst */
+    int do_alloc;
+    double p_alloc;
+    heapent_t e;
+
+    parse_sizes("power:1.5:16:4096", &sizes);
+    parse_lifetimes("exp:200", &lifetimes);
+
+    while ((c = getopt(argc, argv, "o:n:s:w:d:l:p:r:b:h")) != EOF) {
+        switch (c) {
+        case 'o': /* Output file */
+            outfile = optarg;
+            break;
+        case 'n': /* Number of ops before the final cleanup frees */
+            n = atol(optarg);
+            break;
+        case 's': /* Random seed */
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'w': /* Workload model */
+            model = optarg;
+            break;
+        case 'd': /* Size distribution */
+            parse_sizes(optarg, &sizes);
+            break;
+        case 'l': /* Lifetime distribution */
+            parse_lifetimes(optarg, &lifetimes);
+            break;
+        case 'p': /* Number of phases */
+            phases = atoi(optarg);
+            break;
+        case 'r': /* Realloc chain probability */
+            realloc_prob = atof(optarg);
+            break;
+        case 'b': /* Producer/consumer burst length */
+            burst = atoi(optarg);
+            break;
+        case 'h': /* Print this message */
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+
+    if (n <= 0 || phases <= 0 || burst <= 0 ||
+        realloc_prob < 0.0 || realloc_prob > 1.0)
+        app_error("gentrace: bad numeric argument");
+    if (strcmp(model, "steady") && strcmp(model, "ramp") &&
+        strcmp(model, "prodcons"))
+        app_error("gentrace: unknown workload model");
+
+    /* splitmix-style seeding so that small seeds give unrelated streams */
+    rng_state = seed * 0x9E3779B97F4A7C15ULL + 0x632BE59BD9B4E019ULL;
+
+    /* Every phase scales request sizes by a factor in [1/4, 4] */
+    if ((phase_scale = malloc(phases * sizeof(double))) == NULL)
+        app_error("gentrace: malloc failed");
+    phase_scale[0] = 1.0;
+    for (i = 1; i < phases; i++)
+        phase_scale[i] = pow(4.0, 2.0 * rng_uniform() - 1.0);
+
+    for (t = 0; t < n; t++) {
+        phase = (int)(t * phases / n);
+
+        /* Decide between allocating and freeing */
+        if (heap_n == 0) {
+            do_alloc = 1;
+        }
+        else if (!strcmp(model, "steady")) {
+            do_alloc = heap[0].death > t;
+        }
+        else if (!strcmp(model, "ramp")) {
+            p_alloc = (t < n / 2) ? 0.75 : 0.25;
+            do_alloc = rng_uniform() < p_alloc;
+        }
+        else { /* prodcons */
+            if (burst_left == 0) {
+                producing = !producing;
+                burst_left = 1 + (int)(rng_uniform() * burst);
+            }
+            burst_left--;
+            do_alloc = producing;
+        }
+
+        if (!do_alloc) {
+            e = heap_pop();
+            if (e.id == chain_id)
+                chain_id = -1;
+            live_bytes -= block_size[e.id];
+            emit('f', e.id, 0);
+            continue;
+        }
+
+        /* Continue or start a realloc growth chain */
+        if (chain_id >= 0 && chain_left > 0 && rng_uniform() < realloc_prob) {
+            size_t newsize = block_size[chain_id] +
+                1 + (size_t)(rng_uniform() * block_size[chain_id] / 4);
+            if (newsize > MAXSIZE)
+                newsize = MAXSIZE;
+            live_bytes += newsize - block_size[chain_id];
+            block_size[chain_id] = newsize;
+            emit('r', chain_id, newsize);
+            chain_left--;
+        }
+        else {
+            if (num_ids == max_ids) {
+                max_ids = max_ids ? 2 * max_ids : 1024;
+                if ((block_size = realloc(block_size, max_ids * sizeof(size_t))) == NULL)
+                    app_error("gentrace: realloc failed");
+            }
+            id = num_ids++;
+            block_size[id] = sample_size(&sizes, phase_scale[phase]);
+            live_bytes += block_size[id];
+            emit('a', id, block_size[id]);
+
+            if (!strcmp(model, "prodcons"))
+                heap_push(t, id); /* FIFO: oldest message is consumed first */
+            else
+                heap_push(t + sample_lifetime(&lifetimes), id);
+
+            if (realloc_prob > 0.0 && (chain_id < 0 || chain_left == 0)) {
+                chain_id = id;
+                chain_left = 1 + (int)(rng_uniform() * MAXCHAIN);
+            }
+        }
+        if (live_bytes > peak_bytes)
+            peak_bytes = live_bytes;
+    }
+
+    /* Free the stragglers so that the trace is balanced */
+    while (heap_n > 0) {
+        e = heap_pop();
+        emit('f', e.id, 0);
+    }
+
+    if (outfile == NULL) {
+        write_trace(stdout);
+    }
+    else {
+        if ((fp = fopen(outfile, "w")) == NULL) {
+            fprintf(stderr, "Could not open %s: %s\n", outfile, strerror(errno));
+            exit(1);
+        }
+        write_trace(fp);
+        fclose(fp);
+    }
+
+    free(phase_scale);
+    free(ops);
+    free(heap);
+    free(block_size);
+    exit(0);
+}
+
+/*****************************************************
+ * Random numbers and the workload distributions
+ ****************************************************/
+
+/*
+ * rng_uniform - uniform double in [0, 1) from a xorshift64* generator
+ */
+static double rng_uniform(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (double)((rng_state * 0x2545F4914F6CDD1DULL) >> 11) / 9007199254740992.0;
+}
+
+/*
+ * sample_size - draw a request size, scaled by the current phase's factor
+ */
+static size_t sample_size(sizedist_t *d, double scale)
+{
+    double u = rng_uniform();
+    double size;
+
+    switch (d->kind) {
+    case SZ_FIXED:
+        size = d->classes[(int)(u * d->nclasses)];
+        break;
+    case SZ_UNIFORM:
+        size = d->a + u * (d->b - d->a + 1);
+        break;
+    case SZ_POWER: { /* bounded Pareto with exponent a on [b, c] */
+        double la = pow(d->b, -d->a), lc = pow(d->c, -d->a);
+        size = pow(la - u * (la - lc), -1.0 / d->a);
+        break;
+    }
+    default: /* SZ_BIMODAL: a with probability c, otherwise b, +-12.5% */
+        size = (u < d->c) ? d->a : d->b;
+        size *= 0.875 + 0.25 * rng_uniform();
+        break;
+    }
+
+    size *= scale;
+    if (size < 1)
+        size = 1;
+    if (size > MAXSIZE)
+        size = MAXSIZE;
+    return (size_t)size;
+}
+
+/*
+ * sample_lifetime - draw a lifetime in ops (at least 1)
+ */
+static long sample_lifetime(lifedist_t *d)
+{
+    double u = rng_uniform();
+    double life;
+
+    switch (d->kind) {
+    case LT_FIXED:
+        life = d->a;
+        break;
+    case LT_UNIFORM:
+        life = d->a + u * (d->b - d->a + 1);
+        break;
+    case LT_EXP:
+        life = -d->a * log(1.0 - u);
+        break;
+    default: /* LT_PARETO: exponent a, minimum b; heavy tail of long-lived blocks */
+        life = d->b * pow(1.0 - u, -1.0 / d->a);
+        break;
+    }
+    return (life < 1) ? 1 : (long)life;
+}
+
+/*
+ * parse_sizes - parse a size distribution spec:
+ *   fixed:S1,S2,...        uniform choice among size classes
+ *   uniform:MIN:MAX        uniform in [MIN, MAX]
+ *   power:ALPHA:MIN:MAX    bounded power law (Pareto) on [MIN, MAX]
+ *   bimodal:S1:S2:P        S1 with probability P, otherwise S2
+ */
+static void parse_sizes(char *spec, sizedist_t *d)
+{
+    char *p, *end;
+    unsigned long long size;
+
+    memset(d, 0, sizeof(*d));
+    if (!strncmp(spec, "fixed:", 6)) {
+        d->kind = SZ_FIXED;
+        /* every class must be a number in [1, MAXSIZE], and nothing may
+           follow the last one */
+        for (p = spec + 6; d->nclasses < MAXCLASSES; p = end + 1) {
+            errno = 0;
+            size = strtoull(p, &end, 0);
+            if (end == p || errno != 0 || size < 1 || size > MAXSIZE)
+                app_error("gentrace: bad fixed size classes");
+            d->classes[d->nclasses++] = size;
+            if (*end != ',')
+                break;
+        }
+        if (*end != '\0')
+            app_error("gentrace: bad fixed size classes");
+    }
+    else if (sscanf(spec, "uniform:%lf:%lf", &d->a, &d->b) == 2) {
+        d->kind = SZ_UNIFORM;
+        if (d->a < 1 || d->b < d->a || d->b > MAXSIZE)
+            app_error("gentrace: bad uniform size range");
+    }
+    else if (sscanf(spec, "power:%lf:%lf:%lf", &d->a, &d->b, &d->c) == 3) {
+        d->kind = SZ_POWER;
+        if (d->a <= 0 || d->b < 1 || d->c < d->b || d->c > MAXSIZE)
+            app_error("gentrace: bad power-law size parameters");
+    }
+    else if (sscanf(spec, "bimodal:%lf:%lf:%lf", &d->a, &d->b, &d->c) == 3) {
+        d->kind = SZ_BIMODAL;
+        if (d->a < 1 || d->b < 1 || d->a > MAXSIZE || d->b > MAXSIZE ||
+            d->c < 0 || d->c > 1)
+            app_error("gentrace: bad bimodal size parameters");
+    }
+    else {
+        app_error("gentrace: unknown size distribution");
+    }
+}
+
+/*
+ * parse_lifetimes - parse a lifetime distribution spec (in ops):
+ *   fixed:N             every block lives N ops
+ *   uniform:MIN:MAX     uniform in [MIN, MAX]
+ *   exp:MEAN            exponential with the given mean
+ *   pareto:ALPHA:MIN    Pareto with exponent ALPHA and minimum MIN
+ */
+static void parse_lifetimes(char *spec, lifedist_t *d)
+{
+    memset(d, 0, sizeof(*d));
+    if (sscanf(spec, "fixed:%lf", &d->a) == 1)
+        d->kind = LT_FIXED;
+    else if (sscanf(spec, "uniform:%lf:%lf", &d->a, &d->b) == 2)
+        d->kind = LT_UNIFORM;
+    else if (sscanf(spec, "exp:%lf", &d->a) == 1)
+        d->kind = LT_EXP;
+    else if (sscanf(spec, "pareto:%lf:%lf", &d->a, &d->b) == 2)
+        d->kind = LT_PARETO;
+    else
+        app_error("gentrace: unknown lifetime distribution");
+
+    if (d->a <= 0 || (d->kind == LT_UNIFORM && d->b < d->a) ||
+        (d->kind == LT_PARETO && d->b <= 0))
+        app_error("gentrace: bad lifetime parameters");
+}
+
+/*****************************************
+ * Op list, death heap and trace output
+ ****************************************/
+
+/*
+ * emit - append an op to the generated trace
+ */
+static void emit(char type, long index, size_t size)
+{
+    if (num_ops == max_ops) {
+        max_ops = max_ops ? 2 * max_ops : 4096;
+        if ((ops = realloc(ops, max_ops * sizeof(genop_t))) == NULL)
+            app_error("gentrace: realloc failed");
+    }
+    ops[num_ops].type = type;
+    ops[num_ops].index = index;
+    ops[num_ops].size = size;
+    num_ops++;
+}
+
+/*
+ * heap_push - add a live block to the death heap
+ */
+static void heap_push(long death, long id)
+{
+    long i = heap_n++;
+    heapent_t tmp;
+
+    if (heap_n > heap_max) {
+        heap_max = heap_max ? 2 * heap_max : 1024;
+        if ((heap = realloc(heap, heap_max * sizeof(heapent_t))) == NULL)
+            app_error("gentrace: realloc failed");
+    }
+    heap[i].death = death;
+    heap[i].id = id;
+
+    /* sift up; ties go to the lower id so the output is deterministic */
+    while (i > 0) {
+        long parent = (i - 1) / 2;
+        if (heap[parent].death < heap[i].death ||
+            (heap[parent].death == heap[i].death && heap[parent].id < heap[i].id))
+            break;
+        tmp = heap[parent];
+        heap[parent] = heap[i];
+        heap[i] = tmp;
+        i = parent;
+    }
+}
+
+/*
+ * heap_pop - remove and return the block that is due to die first
+ */
+static heapent_t heap_pop(void)
+{
+    heapent_t top = heap[0], tmp;
+    long i = 0, child;
+
+    heap[0] = heap[--heap_n];
+    for (;;) {
+        child = 2 * i + 1;
+        if (child >= heap_n)
+            break;
+        if (child + 1 < heap_n &&
+            (heap[child + 1].death < heap[child].death ||
+             (heap[child + 1].death == heap[child].death &&
+              heap[child + 1].id < heap[child].id)))
+            child++;
+        if (heap[i].death < heap[child].death ||
+            (heap[i].death == heap[child].death && heap[i].id < heap[child].id))
+            break;
+        tmp = heap[child];
+        heap[child] = heap[i];
+        heap[i] = tmp;
+        i = child;
+    }
+    return top;
+}
+
+/*
+ * write_trace - write the header and the ops in .rep format
+ */
+static void write_trace(FILE *fp)
+{
+    long i;
+
+    fprintf(fp, "%zu\n%ld\n%ld\n%d\n", peak_bytes, num_ids, num_ops, 1);
+    for (i = 0; i < num_ops; i++) {
+        if (ops[i].type == 'f')
+            fprintf(fp, "f %ld\n", ops[i].index);
+        else
+            fprintf(fp, "%c %ld %zu\n", ops[i].type, ops[i].index, ops[i].size);
+    }
+}
+
+/*************************************
+ * Some miscellaneous helper routines
+ ************************************/
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+static void app_error(char *msg)
+{
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: gentrace [-h] [-o <file>] [-n <ops>] [-s <seed>] [-w <model>]\n");
+    fprintf(stderr, "                [-d <sizes>] [-l <lifetimes>] [-p <phases>] [-r <prob>] [-b <burst>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-o <file>   Write the trace to <file> (default: stdout).\n");
+    fprintf(stderr, "\t-n <ops>    Number of ops before the final frees (default 10000).\n");
+    fprintf(stderr, "\t-s <seed>   Random seed (default 1).\n");
+    fprintf(stderr, "\t-w <model>  steady, ramp or prodcons (default steady).\n");
+    fprintf(stderr, "\t-d <sizes>  fixed:S1,S2,..  uniform:MIN:MAX  power:ALPHA:MIN:MAX\n");
+    fprintf(stderr, "\t            bimodal:S1:S2:P (default power:1.5:16:4096).\n");
+    fprintf(stderr, "\t-l <life>   fixed:N  uniform:MIN:MAX  exp:MEAN  pareto:ALPHA:MIN\n");
+    fprintf(stderr, "\t            (default exp:200), in ops.\n");
+    fprintf(stderr, "\t-p <n>      Split the trace into n phases with different size scales.\n");
+    fprintf(stderr, "\t-r <prob>   Probability that an alloc grows a block by realloc instead.\n");
+    fprintf(stderr, "\t-b <n>      Max burst length for the prodcons model (default 64).\n");
+    fprintf(stderr, "\t-h          Print this message.\n");
+}
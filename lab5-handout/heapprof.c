@@ -0,0 +1,282 @@
+/*
+ * heapprof.c - storage and reporting for the sampling heap profiler
+ *
+ * Records live in an open-addressing hash table keyed by block address
+ * (linear probing, tombstones on delete). The table and the scratch
+ * space used by heapprof_dump come straight from mmap, so the profiler
+ * never calls malloc and can sit under any allocator.
+ *
+ * Threads sample concurrently, so one mutex guards the table and the
+ * random number generator. Nothing that might call malloc (backtrace,
+ * stdio) runs while it is held, or a sampled allocation made from
+ * there would deadlock on it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "heapprof.h"
+
+#define INIT_CAP 1024   /* initial table size (a power of two) */
+#define TOMB ((void *)1) /* marks a deleted slot */
+
+/* One live sampled block */
+typedef struct {
+    void *ptr;                   /* block pointer, NULL or TOMB if unused */
+    size_t size;                 /* requested bytes */
+    double weight;               /* estimated bytes this sample stands for */
+    int depth;                   /* frames in pc */
+    void *pc[HEAPPROF_DEPTH];    /* allocation call stack, innermost first */
+} sample_t;
+
+static sample_t *table = NULL;
+static size_t cap = 0;           /* number of slots */
+static size_t used = 0;          /* live records */
+static size_t tombs = 0;         /* deleted slots */
+static unsigned long long rng = 0x2545f4914f6cdd1dULL;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* function prototypes */
+static void *map(size_t bytes);
+static sample_t *lookup(void *ptr, int insert);
+static void grow(void);
+static int cmp_stack(const void *a, const void *b);
+
+/*
+ * heapprof_next_interval - Draw the bytes until the next sample
+ */
+size_t heapprof_next_interval(size_t rate)
+{
+    double u;
+
+    pthread_mutex_lock(&lock);
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    u = ((rng >> 11) + 1) * (1.0 / 9007199254740992.0); /* (0, 1] */
+    pthread_mutex_unlock(&lock);
+    return (size_t)(-log(u) * rate) + 1;
+}
+
+/*
+ * heapprof_record - Store a record for ptr with the current call stack
+ */
+void heapprof_record(void *ptr, size_t size, size_t rate, int skip)
+{
+    void *pc[HEAPPROF_DEPTH + 8];
+    sample_t *s;
+    int n;
+
+    /* skip this frame as well as the caller's */
+    n = backtrace(pc, HEAPPROF_DEPTH + 8);
+    skip = (skip + 1 < n) ? skip + 1 : n;
+
+    pthread_mutex_lock(&lock);
+    if ((used + tombs + 1) * 2 > cap)
+        grow();
+    s = lookup(ptr, 1);
+    if (s->ptr == TOMB)
+        tombs--;
+    if (s->ptr != ptr)
+        used++;
+    s->ptr = ptr;
+    s->size = size;
+    /* a block of size bytes is sampled with probability 1 - e^(-size/rate) */
+    s->weight = size / -expm1(-(double)size / rate);
+    s->depth = (n - skip > HEAPPROF_DEPTH) ? HEAPPROF_DEPTH : n - skip;
+    memcpy(s->pc, pc + skip, s->depth * sizeof(void *));
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * heapprof_drop - Delete the record of ptr, if any
+ */
+void heapprof_drop(void *ptr)
+{
+    sample_t *s;
+
+    pthread_mutex_lock(&lock);
+    if (used > 0 && (s = lookup(ptr, 0)) != NULL) {
+        s->ptr = TOMB;
+        used--;
+        tombs++;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * heapprof_size - Requested size in the record of ptr, 0 if it has none
+ */
+size_t heapprof_size(void *ptr)
+{
+    sample_t *s;
+    size_t size = 0;
+
+    pthread_mutex_lock(&lock);
+    if (used > 0 && (s = lookup(ptr, 0)) != NULL)
+        size = s->size;
+    pthread_mutex_unlock(&lock);
+    return size;
+}
+
+/*
+ * heapprof_clear - Delete every record
+ */
+void heapprof_clear(void)
+{
+    pthread_mutex_lock(&lock);
+    if (used + tombs > 0)
+        memset(table, 0, cap * sizeof(sample_t));
+    used = tombs = 0;
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * heapprof_count - Number of live records
+ */
+size_t heapprof_count(void)
+{
+    return __atomic_load_n(&used, __ATOMIC_RELAXED);
+}
+
+/*
+ * heapprof_summary - Count the records and sum their weights
+ */
+void heapprof_summary(size_t *samples, double *est_bytes)
+{
+    size_t i;
+
+    pthread_mutex_lock(&lock);
+    *samples = used;
+    *est_bytes = 0;
+    for (i = 0; i < cap; i++)
+        if (table[i].ptr != NULL && table[i].ptr != TOMB)
+            *est_bytes += table[i].weight;
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * heapprof_dump - Write the records as a legacy pprof heap profile.
+ *    Counts and bytes are the raw sampled ones; pprof scales them back
+ *    up using the rate in the header.
+ */
+int heapprof_dump(FILE *fp, size_t rate)
+{
+    sample_t *copy, **v;
+    size_t i, j, n = 0, bytes = 0, len;
+    int stacks = 0, k;
+    FILE *maps;
+    char line[512];
+
+    /* snapshot the records, then sort and print them unlocked */
+    pthread_mutex_lock(&lock);
+    len = (used + 1) * (sizeof(sample_t) + sizeof(sample_t *));
+    copy = map(len);
+    v = (sample_t **)(copy + used + 1);
+    for (i = 0; i < cap; i++) {
+        if (table[i].ptr != NULL && table[i].ptr != TOMB) {
+            copy[n] = table[i];
+            v[n] = &copy[n];
+            bytes += copy[n++].size;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    qsort(v, n, sizeof(sample_t *), cmp_stack);
+
+    fprintf(fp, "heap profile: %zu: %zu [%zu: %zu] @ heap_v2/%zu\n",
+            n, bytes, n, bytes, rate);
+    for (i = 0; i < n; i = j) {
+        size_t objs = 0, sz = 0;
+
+        for (j = i; j < n && cmp_stack(&v[i], &v[j]) == 0; j++) {
+            objs++;
+            sz += v[j]->size;
+        }
+        fprintf(fp, "%zu: %zu [%zu: %zu] @", objs, sz, objs, sz);
+        for (k = 0; k < v[i]->depth; k++)
+            fprintf(fp, " %p", v[i]->pc[k]);
+        fprintf(fp, "\n");
+        stacks++;
+    }
+    munmap(copy, len);
+
+    /* pprof symbolizes the addresses with the process's memory map */
+    fprintf(fp, "\nMAPPED_LIBRARIES:\n");
+    if ((maps = fopen("/proc/self/maps", "r")) != NULL) {
+        while (fgets(line, sizeof(line), maps) != NULL)
+            fputs(line, fp);
+        fclose(maps);
+    }
+    return stacks;
+}
+
+/*
+ * map - Get zeroed memory straight from the kernel
+ */
+static void *map(size_t bytes)
+{
+    void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "heapprof: mmap failed\n");
+        exit(1);
+    }
+    return p;
+}
+
+/*
+ * lookup - Find the slot of ptr. If it has none, return NULL, or with
+ *    insert set, the first free or deleted slot on its probe sequence.
+ */
+static sample_t *lookup(void *ptr, int insert)
+{
+    size_t i = ((size_t)ptr >> 4) * 0x9e3779b97f4a7c15ULL & (cap - 1);
+    sample_t *free_slot = NULL;
+
+    for (;; i = (i + 1) & (cap - 1)) {
+        if (table[i].ptr == ptr)
+            return &table[i];
+        if (table[i].ptr == TOMB) {
+            if (free_slot == NULL)
+                free_slot = &table[i];
+        }
+        else if (table[i].ptr == NULL)
+            return !insert ? NULL : free_slot ? free_slot : &table[i];
+    }
+}
+
+/*
+ * grow - Rebuild the table at twice the size (or the same size if it
+ *    is mostly tombstones), dropping the tombstones
+ */
+static void grow(void)
+{
+    sample_t *old = table;
+    size_t i, oldcap = cap;
+
+    cap = (cap == 0) ? INIT_CAP : (used * 4 > cap) ? 2 * cap : cap;
+    table = map(cap * sizeof(sample_t));
+    tombs = 0;
+    for (i = 0; i < oldcap; i++)
+        if (old[i].ptr != NULL && old[i].ptr != TOMB)
+            *lookup(old[i].ptr, 1) = old[i];
+    if (old != NULL)
+        munmap(old, oldcap * sizeof(sample_t));
+}
+
+/*
+ * cmp_stack - qsort comparison that groups records with the same stack
+ */
+static int cmp_stack(const void *a, const void *b)
+{
+    const sample_t *x = *(sample_t * const *)a, *y = *(sample_t * const *)b;
+
+    if (x->depth != y->depth)
+        return x->depth - y->depth;
+    return memcmp(x->pc, y->pc, x->depth * sizeof(void *));
+}
@@ -0,0 +1,45 @@
+/*
+ * heapprof.h - storage and reporting for the sampling heap profiler
+ *
+ * mm.c decides which blocks to sample (on average one every
+ * mm_sample_set_rate() bytes) and calls heapprof_record/heapprof_drop;
+ * this module keeps one record with the allocation's call stack per
+ * live sampled block and writes them out as a heap profile.
+ */
+#ifndef __HEAPPROF_H_
+#define __HEAPPROF_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define HEAPPROF_DEPTH 32 /* max call stack frames kept per sample */
+
+/* Bytes to allocate until the next sample: exponential with mean rate,
+   so that sampling points form a Poisson process over allocated bytes */
+size_t heapprof_next_interval(size_t rate);
+
+/* Remember the live sampled block ptr of size bytes, with the caller's
+   stack minus the innermost skip frames */
+void heapprof_record(void *ptr, size_t size, size_t rate, int skip);
+
+/* Forget ptr if it has a record */
+void heapprof_drop(void *ptr);
+
+/* Requested size in the record of ptr, or 0 if it has none */
+size_t heapprof_size(void *ptr);
+
+/* Forget every record (the heap was reset) */
+void heapprof_clear(void);
+
+/* Number of live records */
+size_t heapprof_count(void);
+
+/* Number of live records and the estimated live bytes they stand for */
+void heapprof_summary(size_t *samples, double *est_bytes);
+
+/* Write the live records in pprof's legacy heap profile format
+   ("heap_v2"), one line per distinct stack, followed by the process's
+   memory map. Return the number of stacks written */
+int heapprof_dump(FILE *fp, size_t rate);
+
+#endif /* __HEAPPROF_H_ */
@@ -0,0 +1,86 @@
+/*
+ * lathist.c - log-bucketed latency histograms
+ *
+ * See lathist.h for the bucket layout.
+ */
+#include <string.h>
+#include "lathist.h"
+
+/*
+ * bucket_of - map a value to its bucket index
+ */
+static int bucket_of(unsigned long long val)
+{
+    int e;
+
+    if (val < LATHIST_SUB_COUNT)
+        return (int)val;
+
+    e = 63 - __builtin_clzll(val); /* position of the top bit */
+    return (e - LATHIST_SUB_BITS + 1) * LATHIST_SUB_COUNT +
+        (int)((val >> (e - LATHIST_SUB_BITS)) & (LATHIST_SUB_COUNT - 1));
+}
+
+/*
+ * bucket_top - largest value that maps to bucket b
+ */
+static unsigned long long bucket_top(int b)
+{
+    int e;
+    unsigned long long sub;
+
+    if (b < LATHIST_SUB_COUNT)
+        return (unsigned long long)b;
+
+    e = b / LATHIST_SUB_COUNT + LATHIST_SUB_BITS - 1;
+    sub = (unsigned long long)(b % LATHIST_SUB_COUNT);
+    return ((LATHIST_SUB_COUNT + sub + 1) << (e - LATHIST_SUB_BITS)) - 1;
+}
+
+/*
+ * lathist_reset - empty the histogram
+ */
+void lathist_reset(lathist_t *h)
+{
+    memset(h, 0, sizeof(*h));
+}
+
+/*
+ * lathist_add - record one value
+ */
+void lathist_add(lathist_t *h, unsigned long long val)
+{
+    h->counts[bucket_of(val)]++;
+    if (h->n == 0 || val < h->min)
+        h->min = val;
+    if (val > h->max)
+        h->max = val;
+    h->n++;
+    h->sum += (double)val;
+}
+
+/*
+ * lathist_percentile - value at percentile p, rounded up to its bucket top
+ */
+unsigned long long lathist_percentile(const lathist_t *h, double p)
+{
+    unsigned long long rank, seen = 0;
+    int b;
+
+    if (h->n == 0)
+        return 0;
+
+    /* rank of the wanted value, origin 1 */
+    rank = (unsigned long long)(p / 100.0 * (double)h->n + 0.5);
+    if (rank < 1)
+        rank = 1;
+    if (rank > h->n)
+        rank = h->n;
+
+    for (b = 0; b < LATHIST_BUCKETS; b++) {
+        seen += h->counts[b];
+        if (seen >= rank)
+            return (bucket_top(b) < h->max) ? bucket_top(b) : h->max;
+    }
+    return h->max;
+}
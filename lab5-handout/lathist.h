@@ -0,0 +1,28 @@
+/*
+ * lathist.h - log-bucketed latency histograms
+ *
+ * Values below 2^LATHIST_SUB_BITS are counted exactly; above that, every
+ * power of two is split into 2^LATHIST_SUB_BITS linear sub-buckets, so a
+ * recorded value is off by at most 1/2^LATHIST_SUB_BITS (HDR-style).
+ */
+#define LATHIST_SUB_BITS 4
+#define LATHIST_SUB_COUNT (1 << LATHIST_SUB_BITS)
+#define LATHIST_BUCKETS (64 * LATHIST_SUB_COUNT)
+
+typedef struct {
+    unsigned long long counts[LATHIST_BUCKETS];
+    unsigned long long n;     /* number of recorded values */
+    unsigned long long min;   /* smallest recorded value */
+    unsigned long long max;   /* largest recorded value */
+    double sum;               /* sum of recorded values (for the mean) */
+} lathist_t;
+
+/* Empty the histogram */
+void lathist_reset(lathist_t *h);
+
+/* Record one value */
+void lathist_add(lathist_t *h, unsigned long long val);
+
+/* Return the value at percentile p (0 < p <= 100), rounded up to the
+   top of its bucket. Returns 0 for an empty histogram */
+unsigned long long lathist_percentile(const lathist_t *h, double p);
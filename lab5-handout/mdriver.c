@@ -15,11 +15,20 @@
 #include <assert.h>
 #include <float.h>
 #include <time.h>
+#include <getopt.h>
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "fcyc.h"
+#include "clock.h"
+#include "lathist.h"
+#include "perfctr.h"
+#include "trace.h"
 #include "config.h"
+#ifdef MM_TRACE
+#include "mmtrace.h"
+#endif
 
 /**********************
  * Constants and macros
@@ -27,9 +36,13 @@
 
 /* Misc */
 #define MAXLINE     1024 /* max string size */
-#define HDRLINES       4 /* number of header lines in a trace file */
+#define RETIMES     2    /* times --baseline re-times a slower-looking trace */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
 
+/* Long-only command line options */
+enum {OPT_JSON = 256, OPT_CSV, OPT_BASELINE, OPT_THRESHOLD,
+      OPT_CI, OPT_WARMUP, OPT_SAMPLES, OPT_BUDGET};
+
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((size_t)(p)) % ALIGNMENT) == 0)
 
@@ -44,24 +57,6 @@ typedef struct range_t {
     struct range_t *next;  /* next list element */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
-typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
-    int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc request */
-} traceop_t;
-
-/* Holds the information for one trace file*/
-typedef struct {
-    int sugg_heapsize;   /* suggested heap size (unused) */
-    int num_ids;         /* number of alloc ids */
-    int num_ops;         /* number of distinct requests */
-    int weight;          /* weight for this trace (unused) */
-    traceop_t *ops;      /* array of requests */
-    char **blocks;       /* array of ptrs returned by malloc */
-    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
-} trace_t;
-
 /*
  * Holds the params to the xxx_speed functions, which are timed by fcyc.
  * This struct is necessary because fcyc accepts only a pointer array
@@ -72,16 +67,63 @@ typedef struct {
     range_t *ranges;
 } speed_t;
 
+/* Per-operation latency histograms (in read_counter units) for one trace, indexed by op type */
+typedef struct {
+    lathist_t hist[3];
+} latency_t;
+
+/* One point of a trace's fragmentation timeline */
+typedef struct {
+    long op;             /* number of ops completed */
+    size_t live;         /* live payload bytes */
+    size_t heap;         /* heap size in bytes */
+    mm_heapinfo_t info;  /* allocated and free block totals */
+} fragpoint_t;
+
+/* Fragmentation timeline of one trace, sampled every interval ops */
+typedef struct {
+    long interval;
+    int n;
+    int max;
+    fragpoint_t *pts;
+} fragseries_t;
+
+/* Payload-touching replay of one trace, split into allocator and app time */
+typedef struct {
+    double secs;                     /* wall time of the replay */
+    unsigned long long alloc_cycles; /* cycles spent inside the allocator */
+    unsigned long long app_cycles;   /* cycles spent writing and reading payloads */
+    double bytes;                    /* payload bytes written and scanned */
+} touch_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* defined for both libc malloc and student malloc package (mm.c) */
     double ops;      /* number of ops (malloc/free) in the trace */
     int valid;       /* was the trace processed correctly by the allocator? */
     double secs;     /* number of secs needed to run the trace */
+    ftimer_stats_t timing; /* sample statistics behind secs */
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
 
+    /* defined only with -P */
+    perfctr_t perf;  /* hardware counters for one run of the trace */
+    perfctr_t base_perf; /* the same on ordinary pages (huge page heaps only) */
+
+    /* defined only with -W */
+    touch_t touch;   /* payload-touching replay */
+
+    /* defined only with -C */
+    double cold_secs;           /* secs with the caches flushed before each run */
+    ftimer_stats_t cold_timing; /* sample statistics behind cold_secs */
+
+    /* defined only when built with -DMM_PROFILE (mdriver.prof) */
+    mm_profile_t prof; /* mm cycles per phase for one run of the trace */
+
+    /* defined only with --baseline */
+    double spread;   /* relative spread of the medians of re-timed runs */
+
     /* Note: secs and util are only defined if valid is true */
 } stats_t;
 
@@ -94,6 +136,9 @@ char msg[MAXLINE];      /* for whenever we need to compose an error message */
 
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
+#ifdef MM_TRACE
+static char *mmtrace_path = "mdriver.mmt"; /* event trace (MMTRACE_FILE) */
+#endif
 
 /* The filenames of the default tracefiles */
 static char *default_tracefiles[] = {
@@ -106,15 +151,11 @@ static char *default_tracefiles[] = {
  *********************/
 
 /* these functions manipulate range lists */
-static int add_range(range_t **ranges, char *lo, int size,
-                     int tracenum, int opnum);
+static int add_range(range_t **ranges, char *lo, size_t size,
+                     int tracenum, long opnum);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
 
-/* These functions read, allocate, and free storage for traces */
-static trace_t *read_trace(char *tracedir, char *filename);
-static void free_trace(trace_t *trace);
-
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace, int tracenum);
 static void eval_libc_speed(void *ptr);
@@ -122,14 +163,42 @@ static void eval_libc_speed(void *ptr);
 /* Routines for evaluating correctnes, space utilization, and speed
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+                           fragseries_t *frag);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_latency(trace_t *trace, latency_t *lat);
+static void eval_mm_soak(char **tracefiles, int num_tracefiles, int passes);
+static void eval_touch(trace_t *trace, int use_mm, double fraction, touch_t *t);
+static void eval_mm_heapprof(trace_t *trace, char *tracename, size_t rate);
+static void eval_mm_base_pages(speed_t *params, size_t max_heap,
+                               perfctr_t *res);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printlatency(char *tracename, latency_t *lat);
+static void printperf(int n, stats_t *stats);
+static void printtlb(int n, stats_t *stats);
+static void printtouch(int n, stats_t *stats);
+static void printcold(int n, stats_t *stats);
+#ifdef MM_PROFILE
+static void printprof(int n, stats_t *stats);
+#endif
+static double fsecs_cold_run(fsecs_test_funct f, void *argp, ftimer_stats_t *st);
+static void printfrag(char *tracename, fragseries_t *frag);
+
+/* Machine-readable results and the baseline regression check */
+static void write_json(char *path, char **tracefiles, int n,
+                       stats_t *mm_stats, stats_t *libc_stats,
+                       double p1, double p2, double perfindex);
+static void write_csv(char *path, char **tracefiles, int n,
+                      stats_t *mm_stats, stats_t *libc_stats,
+                      double p1, double p2, double perfindex);
+static int check_baseline(char *path, double threshold, char **tracefiles,
+                          int n, stats_t *mm_stats, double perfindex);
 static void usage(void);
+static size_t parse_size(char *str);
 static void unix_error(char *msg);
-static void malloc_error(int tracenum, int opnum, char *msg);
+static void malloc_error(int tracenum, long opnum, char *msg);
 static void app_error(char *msg);
 
 /**************
@@ -138,7 +207,7 @@ static void app_error(char *msg);
 int main(int argc, char **argv)
 {
     int i;
-    char c;
+    int c;
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
     trace_t *trace = NULL;     /* stores a single trace file in memory */
@@ -150,6 +219,34 @@ int main(int argc, char **argv)
     int team_check = 0;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int latency = 0;     /* If set, report per-op latency percentiles (-L) */
+    int perf = 0;        /* If set, collect hardware counters (-P) */
+    int huge = 0;        /* If set, -P also compares with ordinary pages */
+    int cpu = -1;        /* If >= 0, pin the driver to this CPU (-c) */
+    char *comma;         /* in the --samples argument */
+    fragseries_t frag = {0, 0, 0, NULL}; /* fragmentation timeline (-F) */
+    int soak_passes = 0; /* If > 0, replay the traces on one aging heap (-S) */
+    size_t max_heap = 0; /* Simulated heap limit, 0 for MAX_HEAP (-m) */
+    double touch = 0;    /* If > 0, fraction of live blocks read per op (-W) */
+    int cold = 0;        /* If set, also time every trace with cold caches (-C) */
+    size_t heap_rate = 0; /* If > 0, heap profile sampling rate in bytes (-H) */
+    char *json_file = NULL;     /* Write results as JSON here (--json) */
+    char *csv_file = NULL;      /* Write results as CSV here (--csv) */
+    char *baseline_file = NULL; /* Compare against this CSV (--baseline) */
+    double threshold = 0.03;    /* Allowed relative regression (--threshold) */
+    int regressions = 0;
+    static struct option long_options[] = {
+        {"json", required_argument, NULL, OPT_JSON},
+        {"csv", required_argument, NULL, OPT_CSV},
+        {"baseline", required_argument, NULL, OPT_BASELINE},
+        {"threshold", required_argument, NULL, OPT_THRESHOLD},
+        {"ci", required_argument, NULL, OPT_CI},
+        {"warmup", required_argument, NULL, OPT_WARMUP},
+        {"samples", required_argument, NULL, OPT_SAMPLES},
+        {"budget", required_argument, NULL, OPT_BUDGET},
+        {NULL, 0, NULL, 0}
+    };
+    latency_t lat;       /* latency histograms for the current trace */
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
@@ -158,8 +255,44 @@ int main(int argc, char **argv)
     /*
      * Read and interpret the command line arguments
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt_long(argc, argv, "f:t:c:F:H:m:M:S:W:hvVgalCLP",
+                            long_options, NULL)) != EOF) {
         switch (c) {
+        case OPT_JSON: /* Write every stat to a JSON file */
+            json_file = optarg;
+            break;
+        case OPT_CSV: /* Write every stat to a CSV file */
+            csv_file = optarg;
+            break;
+        case OPT_BASELINE: /* Fail on regressions against a stored CSV run */
+            baseline_file = optarg;
+            break;
+        case OPT_THRESHOLD: /* Relative regression allowed by --baseline, in % */
+            threshold = atof(optarg) / 100.0;
+            break;
+        case OPT_CI: /* Target 95% CI half-width of a median, in % */
+            if (atof(optarg) <= 0) {
+                usage();
+                exit(1);
+            }
+            set_ftimer_epsilon(atof(optarg) / 100.0);
+            break;
+        case OPT_WARMUP: /* Untimed runs before sampling */
+            set_ftimer_warmup(atoi(optarg));
+            break;
+        case OPT_SAMPLES: /* Fewest and most samples per median: <min>[,<max>] */
+            if ((comma = strchr(optarg, ',')) != NULL)
+                set_ftimer_samples(atoi(optarg), atoi(comma + 1));
+            else
+                set_ftimer_samples(atoi(optarg), atoi(optarg));
+            break;
+        case OPT_BUDGET: /* Seconds one median may take */
+            if (atof(optarg) <= 0) {
+                usage();
+                exit(1);
+            }
+            set_ftimer_budget(atof(optarg));
+            break;
         case 'g': /* Generate summary info for the autograder */
             autograder = 1;
             break;
@@ -178,12 +311,49 @@ int main(int argc, char **argv)
             if (tracedir[strlen(tracedir)-1] != '/')
                 strcat(tracedir, "/"); /* path always ends with "/" */
             break;
+        case 'F': /* Sample fragmentation every <n> ops */
+            if ((frag.interval = atol(optarg)) <= 0)
+                app_error("-F needs a positive op interval");
+            break;
+        case 'H': /* Dump a sampled heap profile at each trace's peak */
+            if ((heap_rate = parse_size(optarg)) == 0)
+                app_error("-H needs a sampling rate in bytes, e.g. 4K");
+            break;
+        case 'm': /* Simulated heap limit, e.g. 512M or 64G */
+            if ((max_heap = parse_size(optarg)) == 0)
+                app_error("-m needs a heap size such as 64M or 16G");
+            break;
+        case 'M': /* How the simulated heap is backed */
+            if (mem_set_backend(optarg) < 0)
+                app_error("-M needs lazy or commit, optionally with prefault, huge or hugetlb");
+            break;
+        case 'S': /* Soak: replay the traces <n> times without resetting */
+            if ((soak_passes = atoi(optarg)) <= 0)
+                app_error("-S needs a positive number of passes");
+            break;
+        case 'C': /* Time with cold caches as well as warm ones */
+            cold = 1;
+            break;
+        case 'c': /* Pin to one CPU for steadier timings */
+            cpu = atoi(optarg);
+            break;
         case 'a': /* Don't check team structure */
             team_check = 0;
             break;
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 'L': /* Time each mm op and print latency percentiles */
+            latency = 1;
+            break;
+        case 'P': /* Collect hardware performance counters */
+            perf = 1;
+            break;
+        case 'W': /* Touch payloads, reading <frac> of the live blocks per op */
+            touch = atof(optarg);
+            if (touch <= 0 || touch > 1)
+                app_error("-W needs a working-set fraction in (0, 1]");
+            break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -236,7 +406,19 @@ int main(int argc, char **argv)
     }
 
     /* Initialize the timing package */
+    if (cpu >= 0 && ftimer_pin_cpu(cpu) < 0)
+        unix_error("Could not pin to the requested CPU");
     init_fsecs();
+    if (cold && !fsecs_cold(0)) {
+        printf("This timer cannot flush the caches between runs, ignoring -C\n");
+        cold = 0;
+    }
+
+    /* Open the hardware counters, or carry on without them */
+    if (perf && perfctr_init() == 0) {
+        printf("Hardware performance counters unavailable, ignoring -P\n");
+        perf = 0;
+    }
 
     /*
      * Optionally run and evaluate the libc malloc package
@@ -262,6 +444,16 @@ int main(int argc, char **argv)
                 if (verbose > 1)
                     printf("and performance.\n");
                 libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
+                fsecs_stats(&libc_stats[i].timing);
+                if (perf)
+                    perfctr_measure(eval_libc_speed, &speed_params,
+                                    &libc_stats[i].perf);
+                if (touch)
+                    eval_touch(trace, 0, touch, &libc_stats[i].touch);
+                if (cold)
+                    libc_stats[i].cold_secs =
+                        fsecs_cold_run(eval_libc_speed, &speed_params,
+                                       &libc_stats[i].cold_timing);
             }
             free_trace(trace);
         }
@@ -271,6 +463,19 @@ int main(int argc, char **argv)
             printf("\nResults for libc malloc:\n");
             printresults(num_tracefiles, libc_stats);
         }
+        if (perf) {
+            printf("\nHardware counters per op for libc malloc:\n");
+            printperf(num_tracefiles, libc_stats);
+        }
+        if (cold) {
+            printf("\nCold vs warm cache for libc malloc:\n");
+            printcold(num_tracefiles, libc_stats);
+        }
+        if (touch) {
+            printf("\nPayload-touching replay for libc malloc "
+                   "(%.0f%% of live blocks read per op):\n", touch * 100.0);
+            printtouch(num_tracefiles, libc_stats);
+        }
     }
 
     /*
@@ -285,7 +490,15 @@ int main(int argc, char **argv)
         unix_error("mm_stats calloc in main failed");
 
     /* Initialize the simulated memory system in memlib.c */
-    mem_init();
+    mem_init(max_heap);
+    huge = perf && mem_hugepage_r(mem_default()) != 0;
+#ifdef MM_TRACE
+    /* mdriver.trace records one extra run of each trace */
+    if (getenv("MMTRACE_FILE"))
+        mmtrace_path = getenv("MMTRACE_FILE");
+    if (mmtrace_start(mmtrace_path, 1) < 0)
+        unix_error("Could not start the event trace");
+#endif
 
     /* Evaluate student's mm malloc package using the K-best scheme */
     for (i=0; i < num_tracefiles; i++) {
@@ -297,12 +510,43 @@ int main(int argc, char **argv)
         if (mm_stats[i].valid) {
             if (verbose > 1)
                 printf("efficiency, ");
-            mm_stats[i].util = eval_mm_util(trace, i, &ranges);
+            mm_stats[i].util = eval_mm_util(trace, i, &ranges,
+                                            frag.interval ? &frag : NULL);
+            if (frag.interval)
+                printfrag(tracefiles[i], &frag);
             speed_params.trace = trace;
             speed_params.ranges = ranges;
             if (verbose > 1)
                 printf("and performance.\n");
             mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+            fsecs_stats(&mm_stats[i].timing);
+            if (perf)
+                perfctr_measure(eval_mm_speed, &speed_params, &mm_stats[i].perf);
+            if (huge)
+                eval_mm_base_pages(&speed_params, max_heap,
+                                   &mm_stats[i].base_perf);
+            if (cold)
+                mm_stats[i].cold_secs =
+                    fsecs_cold_run(eval_mm_speed, &speed_params,
+                                   &mm_stats[i].cold_timing);
+            if (heap_rate)
+                eval_mm_heapprof(trace, tracefiles[i], heap_rate);
+#ifdef MM_PROFILE
+            mm_profile_reset();
+            eval_mm_speed(&speed_params);
+            mm_profile_get(&mm_stats[i].prof);
+#endif
+#ifdef MM_TRACE
+            mmtrace_enable(1);
+            eval_mm_speed(&speed_params);
+            mmtrace_enable(0);
+#endif
+            if (latency) {
+                eval_mm_latency(trace, &lat);
+                printlatency(tracefiles[i], &lat);
+            }
+            if (touch)
+                eval_touch(trace, 1, touch, &mm_stats[i].touch);
         }
         free_trace(trace);
     }
@@ -313,6 +557,47 @@ int main(int argc, char **argv)
         printresults(num_tracefiles, mm_stats);
         printf("\n");
     }
+    if (perf) {
+        printf("Hardware counters per op for mm malloc:\n");
+        printperf(num_tracefiles, mm_stats);
+        printf("\n");
+        if (huge) {
+            printf("dTLB misses per op for mm malloc, ordinary vs huge pages:\n");
+            printtlb(num_tracefiles, mm_stats);
+            printf("\n");
+        }
+        perfctr_deinit();
+    }
+#ifdef MM_PROFILE
+    printf("Allocator time by phase for mm malloc (exclusive " COUNTER_UNIT "):\n");
+    printprof(num_tracefiles, mm_stats);
+    printf("\n");
+#endif
+#ifdef MM_TRACE
+    {
+        uint64_t written, dropped;
+
+        mmtrace_stop(&written, &dropped);
+        printf("Event trace: %llu events written to %s, %llu dropped\n\n",
+               (unsigned long long)written, mmtrace_path,
+               (unsigned long long)dropped);
+    }
+#endif
+    if (cold) {
+        printf("Cold vs warm cache for mm malloc:\n");
+        printcold(num_tracefiles, mm_stats);
+        printf("\n");
+    }
+    if (touch) {
+        printf("Payload-touching replay for mm malloc "
+               "(%.0f%% of live blocks read per op):\n", touch * 100.0);
+        printtouch(num_tracefiles, mm_stats);
+        printf("\n");
+    }
+
+    /* Optionally age one heap over many passes of the traces */
+    if (soak_passes)
+        eval_mm_soak(tracefiles, num_tracefiles, soak_passes);
 
     /*
      * Accumulate the aggregate statistics for the student's mm package
@@ -354,7 +639,7 @@ int main(int argc, char **argv)
 
     }
     else { /* There were errors */
-        perfindex = 0.0;
+        p1 = p2 = perfindex = 0.0;
         printf("Terminated with %d errors\n", errors);
     }
 
@@ -363,7 +648,18 @@ int main(int argc, char **argv)
         printf("perfidx:%.0f\n", perfindex);
     }
 
-    exit(0);
+    /* Machine-readable output and regression gate */
+    if (json_file)
+        write_json(json_file, tracefiles, num_tracefiles,
+                   mm_stats, libc_stats, p1, p2, perfindex);
+    if (csv_file)
+        write_csv(csv_file, tracefiles, num_tracefiles,
+                  mm_stats, libc_stats, p1, p2, perfindex);
+    if (baseline_file)
+        regressions = check_baseline(baseline_file, threshold, tracefiles,
+                                     num_tracefiles, mm_stats, perfindex);
+
+    exit(regressions ? 2 : 0);
 }
 
 
@@ -379,8 +675,8 @@ int main(int argc, char **argv)
  *     size bytes at addr lo. After checking the block for correctness,
  *     we create a range struct for this block and add it to the range list.
  */
-static int add_range(range_t **ranges, char *lo, int size,
-                     int tracenum, int opnum)
+static int add_range(range_t **ranges, char *lo, size_t size,
+                     int tracenum, long opnum)
 {
     char *hi = lo + size - 1;
     range_t *p;
@@ -465,109 +761,6 @@ static void clear_ranges(range_t **ranges)
 }
 
 
-/**********************************************
- * The following routines manipulate tracefiles
- *********************************************/
-
-/*
- * read_trace - read a trace file and store it in memory
- */
-static trace_t *read_trace(char *tracedir, char *filename)
-{
-    FILE *tracefile;
-    trace_t *trace;
-    char type[MAXLINE];
-    char path[MAXLINE / 2]; // hack to get rid of overflow warning on line 496
-    int index, size;
-    int max_index = 0;
-    int op_index;
-    int scan_result = 1;
-
-    if (verbose > 1)
-        printf("Reading tracefile: %s\n", filename);
-
-    /* Allocate the trace record */
-    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
-        unix_error("malloc 1 failed in read_trance");
-
-    /* Read the trace file header */
-    strcpy(path, tracedir);
-    strcat(path, filename);
-    if ((tracefile = fopen(path, "r")) == NULL) {
-        sprintf(msg, "Could not open %s in read_trace", path);
-        unix_error(msg);
-    }
-    scan_result &= fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
-    scan_result &= fscanf(tracefile, "%d", &(trace->num_ids));
-    scan_result &= fscanf(tracefile, "%d", &(trace->num_ops));
-    scan_result &= fscanf(tracefile, "%d", &(trace->weight));        /* not used */
-
-    /* We'll store each request line in the trace in this array */
-    if ((trace->ops =
-         (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
-        unix_error("malloc 2 failed in read_trace");
-
-    /* We'll keep an array of pointers to the allocated blocks here... */
-    if ((trace->blocks =
-         (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
-        unix_error("malloc 3 failed in read_trace");
-
-    /* ... along with the corresponding byte sizes of each block */
-    if ((trace->block_sizes =
-         (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
-        unix_error("malloc 4 failed in read_trace");
-
-    /* read every request line in the trace file */
-    index = 0;
-    op_index = 0;
-    while (fscanf(tracefile, "%s", type) != EOF) {
-        switch(type[0]) {
-        case 'a':
-            scan_result &= fscanf(tracefile, "%u %u", &index, &size);
-            trace->ops[op_index].type = ALLOC;
-            trace->ops[op_index].index = index;
-            trace->ops[op_index].size = size;
-            max_index = (index > max_index) ? index : max_index;
-            break;
-        case 'r':
-            scan_result &= fscanf(tracefile, "%u %u", &index, &size);
-            trace->ops[op_index].type = REALLOC;
-            trace->ops[op_index].index = index;
-            trace->ops[op_index].size = size;
-            max_index = (index > max_index) ? index : max_index;
-            break;
-        case 'f':
-            scan_result &= fscanf(tracefile, "%ud", &index);
-            trace->ops[op_index].type = FREE;
-            trace->ops[op_index].index = index;
-            break;
-        default:
-            printf("Bogus type character (%c) in tracefile %s\n",
-                   type[0], path);
-            exit(1);
-        }
-        op_index++;
-
-    }
-    fclose(tracefile);
-    assert(max_index == trace->num_ids - 1);
-    assert(trace->num_ops == op_index);
-
-    return trace;
-}
-
-/*
- * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
- */
-void free_trace(trace_t *trace)
-{
-    free(trace->ops);         /* free the three arrays... */
-    free(trace->blocks);
-    free(trace->block_sizes);
-    free(trace);              /* and the trace record itself... */
-}
-
 /**********************************************************************
  * The following functions evaluate the correctness, space utilization,
  * and throughput of the libc and mm malloc packages.
@@ -578,10 +771,12 @@ void free_trace(trace_t *trace)
  */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 {
-    int i;
-    int index;
-    int size;
-    char *p;
+    long i;
+    size_t j;
+    long index;
+    size_t size;
+    size_t oldsize;
+    char *p, *newp, *oldp;
 
     /* Reset the heap and free any records in the range list */
     mem_reset_brk();
@@ -628,6 +823,44 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
             trace->block_sizes[index] = size;
             break;
 
+        case REALLOC: /* mm_realloc */
+
+            /* Call the student's realloc */
+            oldp = trace->blocks[index];
+            if ((newp = mm_realloc(oldp, size)) == NULL) {
+                malloc_error(tracenum, i, "mm_realloc failed.");
+                return 0;
+            }
+
+            /* Remove the old region from the range list */
+            remove_range(ranges, oldp);
+
+            /* Check new block for correctness and add it to range list */
+            if (add_range(ranges, newp, size, tracenum, i) == 0)
+                return 0;
+
+            /*
+             * Make sure that the new block contains the data from the old
+             * block and then fill in the new block with the low order byte
+             * of the new index
+             */
+            oldsize = trace->block_sizes[index];
+            if (size < oldsize)
+                oldsize = size;
+            for (j = 0; j < oldsize; j++) {
+                if (newp[j] != (char)(index & 0xFF)) {
+                    malloc_error(tracenum, i, "mm_realloc did not preserve the "
+                                 "data from old block");
+                    return 0;
+                }
+            }
+            memset(newp, index & 0xFF, size);
+
+            /* Remember region */
+            trace->blocks[index] = newp;
+            trace->block_sizes[index] = size;
+            break;
+
         case FREE: /* mm_free */
 
             /* Remove region from list and call student's free function */
@@ -656,20 +889,25 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  *   doesn't allow the students to decrement the brk pointer, so brk
  *   is always the high water mark of the heap.
  *
+ *   If frag is not NULL, the heap is also sampled every frag->interval
+ *   ops (and after the last op) to build a fragmentation timeline.
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+                           fragseries_t *frag)
 {
-    int i;
-    int index;
-    int size;
-    int max_total_size = 0;
-    int total_size = 0;
-    char *p;
+    long i;
+    long index;
+    size_t size, newsize, oldsize;
+    size_t max_total_size = 0;
+    size_t total_size = 0;
+    char *p, *newp, *oldp;
 
     /* initialize the heap and the mm malloc package */
     mem_reset_brk();
     if (mm_init() < 0)
         app_error("mm_init failed in eval_mm_util");
+    if (frag)
+        frag->n = 0;
 
     for (i = 0;  i < trace->num_ops;  i++) {
         switch (trace->ops[i].type) {
@@ -694,6 +932,27 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
                 total_size : max_total_size;
             break;
 
+        case REALLOC: /* mm_realloc */
+            index = trace->ops[i].index;
+            newsize = trace->ops[i].size;
+            oldsize = trace->block_sizes[index];
+
+            oldp = trace->blocks[index];
+            if ((newp = mm_realloc(oldp, newsize)) == NULL)
+                app_error("mm_realloc failed in eval_mm_util");
+
+            /* Remember region and size */
+            trace->blocks[index] = newp;
+            trace->block_sizes[index] = newsize;
+
+            /* Increment current total size */
+            total_size += (newsize - oldsize);
+
+            /* Update statistics */
+            max_total_size = (total_size > max_total_size) ?
+                total_size : max_total_size;
+            break;
+
         case FREE: /* mm_free */
             index = trace->ops[i].index;
             size = trace->block_sizes[index];
@@ -711,6 +970,20 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
             app_error("Nonexistent request type in eval_mm_util");
 
         }
+
+        /* Sample the fragmentation timeline */
+        if (frag && ((i + 1) % frag->interval == 0 || i == trace->num_ops - 1)) {
+            if (frag->n == frag->max) {
+                frag->max = frag->max ? 2 * frag->max : 64;
+                if ((frag->pts = realloc(frag->pts, frag->max * sizeof(fragpoint_t))) == NULL)
+                    unix_error("realloc failed in eval_mm_util");
+            }
+            frag->pts[frag->n].op = i + 1;
+            frag->pts[frag->n].live = total_size;
+            frag->pts[frag->n].heap = mem_heapsize();
+            mm_heapinfo(&frag->pts[frag->n].info);
+            frag->n++;
+        }
     }
 
     return ((double)max_total_size / (double)mem_heapsize());
@@ -723,8 +996,9 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index, size;
-    char *p, *block;
+    long i, index;
+    size_t size, newsize;
+    char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
     /* Reset the heap and initialize the mm package */
@@ -744,6 +1018,15 @@ static void eval_mm_speed(void *ptr)
             trace->blocks[index] = p;
             break;
 
+        case REALLOC: /* mm_realloc */
+            index = trace->ops[i].index;
+            newsize = trace->ops[i].size;
+            oldp = trace->blocks[index];
+            if ((newp = mm_realloc(oldp, newsize)) == NULL)
+                app_error("mm_realloc error in eval_mm_speed");
+            trace->blocks[index] = newp;
+            break;
+
         case FREE: /* mm_free */
             index = trace->ops[i].index;
             block = trace->blocks[index];
@@ -751,10 +1034,423 @@ static void eval_mm_speed(void *ptr)
             break;
 
         default:
-            app_error("Nonexistent request type in eval_mm_valid");
+            app_error("Nonexistent request type in eval_mm_speed");
         }
 }
 
+/*
+ * soak_replay - Replay one trace on the current heap without resetting
+ *    it, then free whatever the trace left allocated. Returns the peak
+ *    payload bytes live during the replay.
+ */
+static size_t soak_replay(trace_t *trace)
+{
+    long i, index;
+    size_t live = 0, peak = 0;
+    char *p;
+
+    for (i = 0; i < trace->num_ids; i++)
+        trace->blocks[i] = NULL;
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        index = trace->ops[i].index;
+
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc */
+            if ((p = mm_malloc(trace->ops[i].size)) == NULL)
+                app_error("mm_malloc error in eval_mm_soak");
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = trace->ops[i].size;
+            live += trace->ops[i].size;
+            break;
+
+        case REALLOC: /* mm_realloc */
+            if ((p = mm_realloc(trace->blocks[index], trace->ops[i].size)) == NULL)
+                app_error("mm_realloc error in eval_mm_soak");
+            trace->blocks[index] = p;
+            live += trace->ops[i].size - trace->block_sizes[index];
+            trace->block_sizes[index] = trace->ops[i].size;
+            break;
+
+        case FREE: /* mm_free */
+            mm_free(trace->blocks[index]);
+            trace->blocks[index] = NULL;
+            live -= trace->block_sizes[index];
+            break;
+
+        default:
+            app_error("Nonexistent request type in eval_mm_soak");
+        }
+        if (live > peak)
+            peak = live;
+    }
+
+    /* Free the stragglers so that the next pass starts from a quiet heap */
+    for (i = 0; i < trace->num_ids; i++) {
+        if (trace->blocks[i] != NULL) {
+            mm_free(trace->blocks[i]);
+            trace->blocks[i] = NULL;
+        }
+    }
+    return peak;
+}
+
+/*
+ * eval_mm_soak - Replay the whole trace set passes times against a single
+ *    heap that is initialized once, and report how throughput and
+ *    utilization drift as the heap ages. Lines are printed for passes
+ *    1, 2, 4, 8, ... and for the last pass.
+ */
+static void eval_mm_soak(char **tracefiles, int num_tracefiles, int passes)
+{
+    trace_t **traces;
+    int i, pass;
+    size_t peak, pass_peak;
+    double ops = 0, start, secs, first_kops = 0, kops = 0;
+    double first_util = 0, util = 0;
+    size_t first_heap;
+    mm_heapinfo_t info;
+
+    /* Keep every trace in memory so passes do not re-read files */
+    if ((traces = malloc(num_tracefiles * sizeof(trace_t *))) == NULL)
+        unix_error("malloc failed in eval_mm_soak");
+    for (i = 0; i < num_tracefiles; i++) {
+        traces[i] = read_trace(tracedir, tracefiles[i]);
+        ops += traces[i]->num_ops;
+    }
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+        app_error("mm_init failed in eval_mm_soak");
+    first_heap = mem_heapsize();
+
+    printf("\nSoak test: %d passes of %d trace%s on one heap\n",
+           passes, num_tracefiles, (num_tracefiles == 1) ? "" : "s");
+    printf("%8s%12s%10s%7s%10s%8s%10s\n",
+           "pass", "total ops", "Kops", "util", "heap", "nfree", "largest");
+
+    for (pass = 1; pass <= passes; pass++) {
+        pass_peak = 0;
+        start = ftimer_now();
+        for (i = 0; i < num_tracefiles; i++) {
+            peak = soak_replay(traces[i]);
+            if (peak > pass_peak)
+                pass_peak = peak;
+        }
+        secs = ftimer_now() - start;
+
+        kops = (secs > 0) ? (ops / 1e3) / secs : 0;
+        util = (double)pass_peak / (double)mem_heapsize();
+        if (pass == 1) {
+            first_kops = kops;
+            first_util = util;
+        }
+
+        if ((pass & (pass - 1)) == 0 || pass == passes) {
+            mm_heapinfo(&info);
+            printf("%8d%12.0f%10.0f%6.0f%%%10zu%8zu%10zu\n",
+                   pass, ops * pass, kops, util * 100.0, mem_heapsize(),
+                   info.free_blocks, info.largest_free);
+        }
+    }
+
+    printf("Drift from pass 1 to pass %d: throughput %+.1f%%, util %+.1f points, "
+           "heap grew by %zu bytes\n",
+           passes,
+           (first_kops > 0) ? 100.0 * (kops - first_kops) / first_kops : 0.0,
+           100.0 * (util - first_util),
+           mem_heapsize() - first_heap);
+
+    for (i = 0; i < num_tracefiles; i++)
+        free_trace(traces[i]);
+    free(traces);
+}
+
+/*
+ * eval_mm_latency - Replay the trace once, timing every mm call with
+ *    the cycle counter and recording the results in per-op histograms.
+ *    This runs separately from eval_mm_speed so that the timestamps do
+ *    not perturb the throughput numbers.
+ */
+static void eval_mm_latency(trace_t *trace, latency_t *lat)
+{
+    long i, index;
+    int j;
+    size_t size;
+    char *p;
+    unsigned long long start, cycles, ovhd = ~0ULL;
+
+    /* Estimate the cost of a back-to-back counter read */
+    for (j = 0; j < 100; j++) {
+        start = read_counter();
+        cycles = read_counter() - start;
+        if (cycles < ovhd)
+            ovhd = cycles;
+    }
+
+    for (j = 0; j < 3; j++)
+        lathist_reset(&lat->hist[j]);
+
+    /* Reset the heap and initialize the mm package */
+    mem_reset_brk();
+    if (mm_init() < 0)
+        app_error("mm_init failed in eval_mm_latency");
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc */
+            start = read_counter();
+            p = mm_malloc(size);
+            cycles = read_counter() - start;
+            if (p == NULL)
+                app_error("mm_malloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+        case REALLOC: /* mm_realloc */
+            start = read_counter();
+            p = mm_realloc(trace->blocks[index], size);
+            cycles = read_counter() - start;
+            if (p == NULL)
+                app_error("mm_realloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+        case FREE: /* mm_free */
+            start = read_counter();
+            mm_free(trace->blocks[index]);
+            cycles = read_counter() - start;
+            break;
+
+        default:
+            app_error("Nonexistent request type in eval_mm_latency");
+        }
+
+        lathist_add(&lat->hist[trace->ops[i].type],
+                    (cycles > ovhd) ? cycles - ovhd : 0);
+    }
+}
+
+/*
+ * touch_replay - One payload-touching replay of the trace; see eval_touch.
+ *    live[] holds the ids of the live blocks and pos[] the slot of each
+ *    id in live[], so that blocks can be picked and removed in O(1).
+ */
+static void touch_replay(trace_t *trace, int use_mm, double fraction,
+                         long *live, long *pos, touch_t *t)
+{
+    long i, index, nlive = 0, victim;
+    size_t size, off;
+    char *p;
+    double credit = 0, start;
+    unsigned long long seed = 0x9e3779b97f4a7c15ULL, t0, t1, t2;
+    volatile char sink = 0;
+    char sum;
+
+    t->alloc_cycles = t->app_cycles = 0;
+    t->bytes = 0;
+
+    if (use_mm) {
+        mem_reset_brk();
+        if (mm_init() < 0)
+            app_error("mm_init failed in eval_touch");
+    }
+
+    start = ftimer_now();
+    for (i = 0;  i < trace->num_ops;  i++) {
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+
+        /* The allocator's share */
+        t0 = read_counter();
+        switch (trace->ops[i].type) {
+        case ALLOC:
+            p = use_mm ? mm_malloc(size) : malloc(size);
+            break;
+        case REALLOC:
+            p = use_mm ? mm_realloc(trace->blocks[index], size) :
+                realloc(trace->blocks[index], size);
+            break;
+        case FREE:
+            p = trace->blocks[index];
+            if (use_mm)
+                mm_free(p);
+            else
+                free(p);
+            p = NULL;
+            break;
+        default:
+            app_error("Nonexistent request type in eval_touch");
+        }
+        t1 = read_counter();
+
+        /* The application's share: initialize new payloads... */
+        if (trace->ops[i].type == FREE) {
+            victim = live[--nlive];
+            live[pos[index]] = victim;
+            pos[victim] = pos[index];
+        }
+        else {
+            if (p == NULL)
+                app_error("allocation failed in eval_touch");
+            if (trace->ops[i].type == ALLOC) {
+                pos[index] = nlive;
+                live[nlive++] = index;
+            }
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
+            memset(p, index & 0xFF, size);
+            t->bytes += size;
+        }
+
+        /* ... then read one byte per cache line of the working set */
+        credit += fraction * nlive;
+        while (credit >= 1.0) {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            victim = live[seed % nlive];
+            p = trace->blocks[victim];
+            sum = 0;
+            for (off = 0; off < trace->block_sizes[victim]; off += 64)
+                sum += p[off];
+            sink += sum;
+            t->bytes += trace->block_sizes[victim];
+            credit -= 1.0;
+        }
+        t2 = read_counter();
+
+        t->alloc_cycles += t1 - t0;
+        t->app_cycles += t2 - t1;
+    }
+    t->secs = ftimer_now() - start;
+}
+
+/*
+ * eval_touch - Replay the trace the way an application would use the
+ *    memory: every new or resized block is written in full, and after
+ *    each op about fraction of the live blocks, chosen at random, are
+ *    read one cache line at a time. The allocator's cycles and the
+ *    application's cycles are counted separately, so that the cost of
+ *    poor placement shows up as application time. The fastest of three
+ *    replays is kept.
+ */
+static void eval_touch(trace_t *trace, int use_mm, double fraction, touch_t *t)
+{
+    long *live, *pos;
+    touch_t cur;
+    int rep;
+
+    if ((live = malloc(trace->num_ids * sizeof(long))) == NULL ||
+        (pos = malloc(trace->num_ids * sizeof(long))) == NULL)
+        unix_error("malloc failed in eval_touch");
+
+    for (rep = 0; rep < 3; rep++) {
+        touch_replay(trace, use_mm, fraction, live, pos, &cur);
+        if (rep == 0 || cur.alloc_cycles + cur.app_cycles <
+            t->alloc_cycles + t->app_cycles)
+            *t = cur;
+    }
+
+    free(live);
+    free(pos);
+}
+
+/*
+ * eval_mm_heapprof - Replay the trace with the sampling heap profiler on
+ *    and dump the profile of the live heap at the op where the live
+ *    payload peaks, to <trace name>.heap in the current directory. The
+ *    profiler's estimate of the live bytes is checked against the truth.
+ */
+static void eval_mm_heapprof(trace_t *trace, char *tracename, size_t rate)
+{
+    long i, index, peak_op = 0;
+    size_t live = 0, peak = 0, samples;
+    double est;
+    char path[MAXLINE], *base;
+    FILE *fp;
+    int stacks;
+
+    /* Find the peak first, so the replay can stop there */
+    for (i = 0; i < trace->num_ops; i++) {
+        index = trace->ops[i].index;
+        if (trace->ops[i].type == FREE)
+            live -= trace->block_sizes[index];
+        else {
+            if (trace->ops[i].type == REALLOC)
+                live -= trace->block_sizes[index];
+            live += trace->ops[i].size;
+            trace->block_sizes[index] = trace->ops[i].size;
+        }
+        if (live > peak) {
+            peak = live;
+            peak_op = i;
+        }
+    }
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+        app_error("mm_init failed in eval_mm_heapprof");
+    mm_sample_set_rate(rate);
+
+    for (i = 0; i <= peak_op; i++) {
+        index = trace->ops[i].index;
+        switch (trace->ops[i].type) {
+        case ALLOC:
+            if ((trace->blocks[index] = mm_malloc(trace->ops[i].size)) == NULL)
+                app_error("mm_malloc failed in eval_mm_heapprof");
+            break;
+        case REALLOC:
+            if ((trace->blocks[index] = mm_realloc(trace->blocks[index],
+                                                   trace->ops[i].size)) == NULL)
+                app_error("mm_realloc failed in eval_mm_heapprof");
+            break;
+        case FREE:
+            mm_free(trace->blocks[index]);
+            break;
+        default:
+            app_error("Nonexistent request type in eval_mm_heapprof");
+        }
+    }
+
+    base = strrchr(tracename, '/');
+    snprintf(path, sizeof(path), "%s.heap", base ? base + 1 : tracename);
+    if ((fp = fopen(path, "w")) == NULL)
+        unix_error("Could not open the heap profile");
+    stacks = mm_sample_dump(fp);
+    fclose(fp);
+    mm_sample_summary(&samples, &est);
+    mm_sample_set_rate(0);
+
+    printf("Heap profile of %s at op %ld: %zu samples in %d stacks, "
+           "%.0f bytes estimated / %zu live (%+.1f%%), written to %s\n",
+           tracename, peak_op, samples, stacks, est, peak,
+           peak ? 100.0 * (est - peak) / peak : 0.0, path);
+}
+
+/*
+ * eval_mm_base_pages - Measure one speed run with the hardware counters
+ *    on a heap of ordinary pages, for comparison with a huge page heap.
+ *    The default region is remapped for the run and then restored.
+ */
+static void eval_mm_base_pages(speed_t *params, size_t max_heap,
+                               perfctr_t *res)
+{
+    int pages = mem_set_pages(MEM_PAGES_BASE);
+
+    mem_deinit();
+    mem_init(max_heap);
+    perfctr_measure(eval_mm_speed, params, res);
+    mem_deinit();
+    mem_set_pages(pages);
+    mem_init(max_heap);
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -763,7 +1459,8 @@ static void eval_mm_speed(void *ptr)
  */
 static int eval_libc_valid(trace_t *trace, int tracenum)
 {
-    int i, newsize;
+    long i;
+    size_t newsize;
     char *p, *newp, *oldp;
 
     for (i = 0;  i < trace->num_ops;  i++) {
@@ -806,8 +1503,8 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
  */
 static void eval_libc_speed(void *ptr)
 {
-    int i;
-    int index, size, newsize;
+    long i, index;
+    size_t size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
@@ -856,17 +1553,20 @@ static void printresults(int n, stats_t *stats)
     double util = 0;
 
     /* Print the individual results for each trace */
-    printf("%5s%7s %5s%8s%10s%6s\n",
-           "trace", " valid", "util", "ops", "secs", "Kops");
+    printf("%5s%7s %5s%8s%10s%6s%12s%9s\n",
+           "trace", " valid", "util", "ops", "secs", "Kops", "min secs", "95% CI");
     for (i=0; i < n; i++) {
         if (stats[i].valid) {
-            printf("%2d%10s%5.0f%%%8.0f%10.6f%8.0f\n",
+            printf("%2d%10s%5.0f%%%8.0f%10.6f%8.0f%12.6f%7.1f%%\n",
                    i,
                    "yes",
                    stats[i].util*100.0,
                    stats[i].ops,
                    stats[i].secs,
-                   (stats[i].ops/1e3)/stats[i].secs);
+                   (stats[i].ops/1e3)/stats[i].secs,
+                   stats[i].timing.min,
+                   (stats[i].secs > 0) ?
+                   50.0*(stats[i].timing.ci_hi - stats[i].timing.ci_lo)/stats[i].secs : 0.0);
             secs += stats[i].secs;
             ops += stats[i].ops;
             util += stats[i].util;
@@ -902,6 +1602,702 @@ static void printresults(int n, stats_t *stats)
 
 }
 
+/*
+ * printlatency - prints the per-op latency percentiles (in counter units)
+ *    for one trace
+ */
+static void printlatency(char *tracename, latency_t *lat)
+{
+    static char *opnames[] = {"malloc", "free", "realloc"};
+    lathist_t *h;
+    int j;
+
+    printf("\nLatency for %s (" COUNTER_UNIT "):\n", tracename);
+    printf("%8s%8s%8s%8s%8s%10s%10s\n",
+           "op", "count", "mean", "p50", "p99", "p99.9", "max");
+    for (j = 0; j < 3; j++) {
+        h = &lat->hist[j];
+        if (h->n == 0)
+            continue;
+        printf("%8s%8llu%8.0f%8llu%8llu%10llu%10llu\n",
+               opnames[j],
+               h->n,
+               h->sum / (double)h->n,
+               lathist_percentile(h, 50.0),
+               lathist_percentile(h, 99.0),
+               lathist_percentile(h, 99.9),
+               h->max);
+    }
+}
+
+/*
+ * fsecs_cold_run - Time f(argp) with the caches flushed before every run
+ */
+static double fsecs_cold_run(fsecs_test_funct f, void *argp, ftimer_stats_t *st)
+{
+    double secs;
+
+    fsecs_cold(1);
+    secs = fsecs(f, argp);
+    fsecs_stats(st);
+    fsecs_cold(0);
+    return secs;
+}
+
+/*
+ * printcold - prints the warm-cache and cold-cache times of every trace.
+ *    The difference is mostly the cost of missing on allocator metadata
+ *    (headers, free-list links) that a warm loop keeps in cache.
+ */
+static void printcold(int n, stats_t *stats)
+{
+    int i;
+    double ops = 0, warm = 0, coldsecs = 0;
+
+    printf("(caches flushed by sweeping %ld MB before each cold run)\n",
+           fcyc_flush_size() >> 20);
+    printf("%5s%12s%12s%10s%10s%10s\n", "trace", "warm secs", "cold secs",
+           "cold/warm", "warm Kops", "cold Kops");
+    for (i = 0; i < n; i++) {
+        printf("%2d   ", i);
+        if (!stats[i].valid) {
+            printf("\n");
+            continue;
+        }
+        printf("%12.6f%12.6f%10.2f%10.0f%10.0f\n",
+               stats[i].secs, stats[i].cold_secs,
+               stats[i].cold_secs / stats[i].secs,
+               (stats[i].ops / 1e3) / stats[i].secs,
+               (stats[i].ops / 1e3) / stats[i].cold_secs);
+        ops += stats[i].ops;
+        warm += stats[i].secs;
+        coldsecs += stats[i].cold_secs;
+    }
+    if (ops > 0)
+        printf("%5s%12.6f%12.6f%10.2f%10.0f%10.0f\n", "Total", warm, coldsecs,
+               coldsecs / warm, (ops / 1e3) / warm, (ops / 1e3) / coldsecs);
+}
+
+#ifdef MM_PROFILE
+/*
+ * printprof - prints, for every trace, the allocator's cycles per op and
+ *    the share of them spent in each phase of mm.c. The counters cost a
+ *    few tens of cycles per phase entry, so the timings of an
+ *    instrumented build are only good for these ratios.
+ */
+static void printprof(int n, stats_t *stats)
+{
+    int i, j;
+    double ops = 0, all, total[MM_PH_NUM] = {0}, sum = 0;
+
+    printf("%5s%10s", "trace", COUNTER_UNIT "/op");
+    for (j = 0; j < MM_PH_NUM; j++)
+        printf("%10s", mm_phase_names[j]);
+    printf("\n");
+
+    for (i = 0; i < n; i++) {
+        printf("%2d   ", i);
+        if (!stats[i].valid) {
+            printf("\n");
+            continue;
+        }
+        for (all = 0, j = 0; j < MM_PH_NUM; j++)
+            all += stats[i].prof.cycles[j];
+        printf("%10.1f", all / stats[i].ops);
+        for (j = 0; j < MM_PH_NUM; j++) {
+            printf("%9.1f%%", all ? 100.0 * stats[i].prof.cycles[j] / all : 0.0);
+            total[j] += stats[i].prof.cycles[j];
+        }
+        printf("\n");
+        ops += stats[i].ops;
+        sum += all;
+    }
+    if (ops > 0) {
+        printf("%5s%10.1f", "Total", sum / ops);
+        for (j = 0; j < MM_PH_NUM; j++)
+            printf("%9.1f%%", sum ? 100.0 * total[j] / sum : 0.0);
+        printf("\n");
+    }
+}
+#endif
+
+/*
+ * printtouch - prints the payload-touching replay of every trace, with
+ *    the time split between the allocator and the application
+ */
+static void printtouch(int n, stats_t *stats)
+{
+    int i;
+    double ops = 0, secs = 0, bytes = 0, alloc = 0, app = 0;
+    touch_t *t;
+
+    printf("%5s%10s%8s%8s%12s%12s%10s\n", "trace", "secs", "alloc%",
+           "app%", "alloc " COUNTER_UNIT, "app " COUNTER_UNIT, "MB");
+    for (i = 0; i < n; i++) {
+        printf("%2d   ", i);
+        if (!stats[i].valid) {
+            printf("\n");
+            continue;
+        }
+        t = &stats[i].touch;
+        printf("%10.6f%8.1f%8.1f%12.1f%12.1f%10.1f\n", t->secs,
+               100.0 * t->alloc_cycles / (t->alloc_cycles + t->app_cycles),
+               100.0 * t->app_cycles / (t->alloc_cycles + t->app_cycles),
+               t->alloc_cycles / stats[i].ops, t->app_cycles / stats[i].ops,
+               t->bytes / 1e6);
+        ops += stats[i].ops;
+        secs += t->secs;
+        bytes += t->bytes;
+        alloc += t->alloc_cycles;
+        app += t->app_cycles;
+    }
+    if (ops > 0)
+        printf("%5s%10.6f%8.1f%8.1f%12.1f%12.1f%10.1f\n", "Total", secs,
+               100.0 * alloc / (alloc + app), 100.0 * app / (alloc + app),
+               alloc / ops, app / ops, bytes / 1e6);
+}
+
+/*
+ * printperf - prints the hardware counters of every trace, normalized
+ *    to events per op. Counters that could not be measured print as "-".
+ */
+static void printperf(int n, stats_t *stats)
+{
+    int i, j;
+    double ops = 0;
+    double total[PERFCTR_NUM] = {0};
+    int valid[PERFCTR_NUM];
+
+    printf("%5s", "trace");
+    for (j = 0; j < PERFCTR_NUM; j++) {
+        printf("%11s", perfctr_names[j]);
+        valid[j] = 1;
+    }
+    printf("%7s\n", "IPC");
+
+    for (i = 0; i < n; i++) {
+        printf("%2d   ", i);
+        if (!stats[i].valid) {
+            printf("\n");
+            continue;
+        }
+        for (j = 0; j < PERFCTR_NUM; j++) {
+            if (stats[i].perf.valid[j]) {
+                printf("%11.2f", stats[i].perf.count[j] / stats[i].ops);
+                total[j] += stats[i].perf.count[j];
+            }
+            else {
+                printf("%11s", "-");
+                valid[j] = 0;
+            }
+        }
+        if (stats[i].perf.valid[PERFCTR_INSTRUCTIONS] &&
+            stats[i].perf.valid[PERFCTR_CYCLES])
+            printf("%7.2f", stats[i].perf.count[PERFCTR_INSTRUCTIONS] /
+                   stats[i].perf.count[PERFCTR_CYCLES]);
+        printf("\n");
+        ops += stats[i].ops;
+    }
+
+    /* Aggregate over the traces, for counters every trace reported */
+    printf("%5s", "Total");
+    for (j = 0; j < PERFCTR_NUM; j++) {
+        if (valid[j] && ops > 0)
+            printf("%11.2f", total[j] / ops);
+        else
+            printf("%11s", "-");
+    }
+    if (valid[PERFCTR_INSTRUCTIONS] && valid[PERFCTR_CYCLES] &&
+        total[PERFCTR_CYCLES] > 0)
+        printf("%7.2f", total[PERFCTR_INSTRUCTIONS] / total[PERFCTR_CYCLES]);
+    printf("\n");
+}
+
+/*
+ * printtlb - prints the dTLB misses per op of every trace on a heap of
+ *    ordinary pages and on huge pages, and the change between them
+ */
+static void printtlb(int n, stats_t *stats)
+{
+    int i;
+    double ops = 0, base = 0, huge = 0;
+    perfctr_t *b, *h;
+
+    printf("%5s%11s%11s%9s\n", "trace", "4K pages", "2M pages", "change");
+    for (i = 0; i < n; i++) {
+        b = &stats[i].base_perf;
+        h = &stats[i].perf;
+        printf("%2d   ", i);
+        if (!stats[i].valid || !b->valid[PERFCTR_DTLB_MISSES] ||
+            !h->valid[PERFCTR_DTLB_MISSES]) {
+            printf("%11s%11s\n", "-", "-");
+            continue;
+        }
+        printf("%11.3f%11.3f", b->count[PERFCTR_DTLB_MISSES] / stats[i].ops,
+               h->count[PERFCTR_DTLB_MISSES] / stats[i].ops);
+        if (b->count[PERFCTR_DTLB_MISSES] > 0)
+            printf("%8.1f%%", 100.0 * (h->count[PERFCTR_DTLB_MISSES] /
+                                       b->count[PERFCTR_DTLB_MISSES] - 1));
+        printf("\n");
+        ops += stats[i].ops;
+        base += b->count[PERFCTR_DTLB_MISSES];
+        huge += h->count[PERFCTR_DTLB_MISSES];
+    }
+    if (ops > 0) {
+        printf("%5s%11.3f%11.3f", "Total", base / ops, huge / ops);
+        if (base > 0)
+            printf("%8.1f%%", 100.0 * (huge / base - 1));
+        printf("\n");
+    }
+}
+
+/*
+ * printfrag - prints the fragmentation timeline of one trace
+ *    internal: allocated block bytes not holding payload (headers,
+ *              footers, alignment and split slack), as % of the heap
+ *    external: free block bytes, as % of the heap
+ *    scatter:  1 - largest free block / free bytes, i.e. how badly
+ *              the free space is broken up
+ */
+static void printfrag(char *tracename, fragseries_t *frag)
+{
+    int k, worst = 0;
+    double internal, external, scatter, worst_ext = -1;
+    fragpoint_t *pt;
+
+    printf("\nFragmentation timeline for %s:\n", tracename);
+    printf("%8s%10s%10s%10s%8s%10s%7s%7s%7s\n", "op", "live", "heap",
+           "free", "nfree", "largest", "int%", "ext%", "scat%");
+    for (k = 0; k < frag->n; k++) {
+        pt = &frag->pts[k];
+        internal = pt->heap ?
+            100.0 * (pt->info.alloc_bytes - pt->live) / pt->heap : 0.0;
+        external = pt->heap ? 100.0 * pt->info.free_bytes / pt->heap : 0.0;
+        scatter = pt->info.free_bytes ?
+            100.0 * (1.0 - (double)pt->info.largest_free / pt->info.free_bytes) : 0.0;
+        printf("%8ld%10zu%10zu%10zu%8zu%10zu%7.1f%7.1f%7.1f\n",
+               pt->op, pt->live, pt->heap, pt->info.free_bytes,
+               pt->info.free_blocks, pt->info.largest_free,
+               internal, external, scatter);
+        if (pt->live > 0 && external > worst_ext) {
+            worst_ext = external;
+            worst = k;
+        }
+    }
+    if (worst_ext >= 0)
+        printf("Worst external fragmentation while blocks were live: "
+               "%.1f%% at op %ld\n", worst_ext, frag->pts[worst].op);
+}
+
+/*******************************************************************
+ * Machine-readable results (--json, --csv) and the regression gate
+ * (--baseline), which reads back a file written by --csv.
+ ******************************************************************/
+
+/*
+ * total_stats - sum the valid traces of a run into one stats_t
+ *    (util is averaged over all traces, like the performance index)
+ */
+static void total_stats(int n, stats_t *stats, stats_t *total)
+{
+    int i, j;
+
+    memset(total, 0, sizeof(*total));
+    total->valid = 1;
+    for (j = 0; j < PERFCTR_NUM; j++)
+        total->perf.valid[j] = 1;
+
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid) {
+            total->valid = 0;
+            continue;
+        }
+        total->ops += stats[i].ops;
+        total->secs += stats[i].secs;
+        total->util += stats[i].util / n;
+        total->timing.min += stats[i].timing.min;
+        total->timing.ci_lo += stats[i].timing.ci_lo;
+        total->timing.ci_hi += stats[i].timing.ci_hi;
+        total->timing.samples += stats[i].timing.samples;
+        if (stats[i].spread > total->spread)
+            total->spread = stats[i].spread;
+        for (j = 0; j < PERFCTR_NUM; j++) {
+            total->perf.valid[j] &= stats[i].perf.valid[j];
+            total->perf.count[j] += stats[i].perf.count[j];
+        }
+    }
+    total->timing.median = total->secs;
+}
+
+/*
+ * json_string - write s as a JSON string literal
+ */
+static void json_string(FILE *fp, char *s)
+{
+    fputc('"', fp);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fputc('\\', fp);
+        if ((unsigned char)*s < 0x20)
+            fprintf(fp, "\\u%04x", *s);
+        else
+            fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+/*
+ * json_stats - write one stats_t as the members of a JSON object
+ */
+static void json_stats(FILE *fp, stats_t *st, char *indent)
+{
+    int j;
+
+    fprintf(fp, "%s\"valid\": %s,\n", indent, st->valid ? "true" : "false");
+    fprintf(fp, "%s\"ops\": %.0f,\n", indent, st->ops);
+    fprintf(fp, "%s\"util\": %.6f,\n", indent, st->util);
+    fprintf(fp, "%s\"secs\": %.9f,\n", indent, st->secs);
+    fprintf(fp, "%s\"kops\": %.3f,\n", indent,
+            (st->secs > 0) ? (st->ops / 1e3) / st->secs : 0.0);
+    fprintf(fp, "%s\"secs_min\": %.9f,\n", indent, st->timing.min);
+    fprintf(fp, "%s\"secs_ci_lo\": %.9f,\n", indent, st->timing.ci_lo);
+    fprintf(fp, "%s\"secs_ci_hi\": %.9f,\n", indent, st->timing.ci_hi);
+    fprintf(fp, "%s\"samples\": %d,\n", indent, st->timing.samples);
+    fprintf(fp, "%s\"perf\": {", indent);
+    for (j = 0; j < PERFCTR_NUM; j++) {
+        fprintf(fp, "%s\"%s\": ", j ? ", " : "", perfctr_names[j]);
+        if (st->perf.valid[j])
+            fprintf(fp, "%.0f", st->perf.count[j]);
+        else
+            fprintf(fp, "null");
+    }
+    fprintf(fp, "}");
+}
+
+/*
+ * json_run - write the results of one allocator as a JSON object
+ */
+static void json_run(FILE *fp, char **tracefiles, int n, stats_t *stats)
+{
+    stats_t total;
+    int i;
+
+    fprintf(fp, "{\n    \"traces\": [\n");
+    for (i = 0; i < n; i++) {
+        fprintf(fp, "      {\n        \"trace\": ");
+        json_string(fp, tracefiles[i]);
+        fprintf(fp, ",\n");
+        json_stats(fp, &stats[i], "        ");
+        fprintf(fp, "\n      }%s\n", (i < n - 1) ? "," : "");
+    }
+    total_stats(n, stats, &total);
+    fprintf(fp, "    ],\n    \"total\": {\n");
+    json_stats(fp, &total, "      ");
+    fprintf(fp, "\n    }\n  }");
+}
+
+/*
+ * write_json - write every stat of the run, plus the performance index
+ */
+static void write_json(char *path, char **tracefiles, int n,
+                       stats_t *mm_stats, stats_t *libc_stats,
+                       double p1, double p2, double perfindex)
+{
+    FILE *fp;
+
+    if ((fp = fopen(path, "w")) == NULL) {
+        sprintf(msg, "Could not open %s in write_json", path);
+        unix_error(msg);
+    }
+    fprintf(fp, "{\n  \"mm\": ");
+    json_run(fp, tracefiles, n, mm_stats);
+    if (libc_stats) {
+        fprintf(fp, ",\n  \"libc\": ");
+        json_run(fp, tracefiles, n, libc_stats);
+    }
+    fprintf(fp, ",\n  \"p1\": %.6f,\n  \"p2\": %.6f,\n  \"perfindex\": %.6f\n}\n",
+            p1, p2, perfindex);
+    fclose(fp);
+}
+
+/*
+ * csv_row - write one stats_t as a CSV row
+ */
+static void csv_row(FILE *fp, char *allocator, char *trace, stats_t *st)
+{
+    int j;
+
+    fprintf(fp, "%s,%s,%d,%.6f,%.0f,%.9f,%.3f,%.9f,%.9f,%.9f,%d",
+            allocator, trace, st->valid, st->util, st->ops, st->secs,
+            (st->secs > 0) ? (st->ops / 1e3) / st->secs : 0.0,
+            st->timing.min, st->timing.ci_lo, st->timing.ci_hi,
+            st->timing.samples);
+    for (j = 0; j < PERFCTR_NUM; j++) {
+        if (st->perf.valid[j])
+            fprintf(fp, ",%.0f", st->perf.count[j]);
+        else
+            fprintf(fp, ",");
+    }
+}
+
+/*
+ * csv_run - write the per-trace rows and the TOTAL row of one allocator
+ */
+static void csv_run(FILE *fp, char *allocator, char **tracefiles, int n,
+                    stats_t *stats, double p1, double p2, double perfindex)
+{
+    stats_t total;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        csv_row(fp, allocator, tracefiles[i], &stats[i]);
+        fprintf(fp, ",,,\n");
+    }
+    total_stats(n, stats, &total);
+    csv_row(fp, allocator, "TOTAL", &total);
+    if (p1 >= 0)
+        fprintf(fp, ",%.6f,%.6f,%.6f\n", p1, p2, perfindex);
+    else
+        fprintf(fp, ",,,\n");
+}
+
+/*
+ * write_csv - write every stat of the run, one row per allocator and trace
+ */
+static void write_csv(char *path, char **tracefiles, int n,
+                      stats_t *mm_stats, stats_t *libc_stats,
+                      double p1, double p2, double perfindex)
+{
+    FILE *fp;
+    int j;
+
+    if ((fp = fopen(path, "w")) == NULL) {
+        sprintf(msg, "Could not open %s in write_csv", path);
+        unix_error(msg);
+    }
+    fprintf(fp, "allocator,trace,valid,util,ops,secs,kops,"
+            "secs_min,secs_ci_lo,secs_ci_hi,samples");
+    for (j = 0; j < PERFCTR_NUM; j++)
+        fprintf(fp, ",%s", perfctr_names[j]);
+    fprintf(fp, ",p1,p2,perfindex\n");
+
+    csv_run(fp, "mm", tracefiles, n, mm_stats, p1, p2, perfindex);
+    if (libc_stats)
+        csv_run(fp, "libc", tracefiles, n, libc_stats, -1, 0, 0);
+    fclose(fp);
+}
+
+/*
+ * csv_split - split a CSV line in place into at most max fields
+ */
+static int csv_split(char *line, char **fields, int max)
+{
+    int n = 0;
+
+    line[strcspn(line, "\r\n")] = '\0';
+    fields[n++] = line;
+    for (; *line && n < max; line++) {
+        if (*line == ',') {
+            *line = '\0';
+            fields[n++] = line + 1;
+        }
+    }
+    return n;
+}
+
+/*
+ * slower - has the throughput of cur dropped below the baseline's?
+ *    Only if the median dropped by more than the threshold plus the
+ *    run-to-run spread seen while re-timing, the 95% intervals of the
+ *    two medians do not overlap, *and* the fastest run (which other
+ *    load on the machine can only slow down) dropped by the threshold
+ *    too. base_min is 0 for baselines written without secs_min.
+ */
+static int slower(stats_t *cur, double base_ops, double base_secs,
+                  double base_hi, double base_min, double threshold)
+{
+    double cur_kops = (cur->ops / 1e3) / cur->secs;
+    double base_kops = (base_ops / 1e3) / base_secs;
+    double scale = cur->ops / base_ops;
+
+    return cur_kops < base_kops * (1.0 - threshold - cur->spread) &&
+        cur->timing.ci_lo > base_hi * scale &&
+        cur->timing.min * (1.0 - threshold) > base_min * scale;
+}
+
+/*
+ * retime - time trace again, keep the faster of the two medians and the
+ *    fastest run in st, and widen st->spread to cover every median seen
+ */
+static void retime(char *tracename, stats_t *st, double *lo, double *hi)
+{
+    speed_t params;
+    ftimer_stats_t timing;
+    double secs;
+
+    params.trace = read_trace(tracedir, tracename);
+    params.ranges = NULL;
+    secs = fsecs(eval_mm_speed, &params);
+    fsecs_stats(&timing);
+    free_trace(params.trace);
+
+    if (timing.min > st->timing.min)
+        timing.min = st->timing.min;
+    if (secs < st->secs) {
+        st->secs = secs;
+        st->timing = timing;
+    }
+    st->timing.min = timing.min;
+    *lo = (secs < *lo) ? secs : *lo;
+    *hi = (secs > *hi) ? secs : *hi;
+    st->spread = (*hi - *lo) / *hi;
+}
+
+/*
+ * check_regression - compare one trace (or the total) against the baseline
+ *    Throughput is judged by slower(), so noisy traces do not raise
+ *    false alarms.
+ */
+static int check_regression(char *trace, stats_t *cur, double base_util,
+                            double base_ops, double base_secs, double base_min,
+                            double base_lo, double base_hi, double threshold)
+{
+    int bad = 0;
+    double cur_kops = (cur->ops / 1e3) / cur->secs;
+    double base_kops = (base_ops / 1e3) / base_secs;
+
+    if (cur->util < base_util * (1.0 - threshold)) {
+        printf("REGRESSION %s: util %.1f%% -> %.1f%%\n",
+               trace, base_util * 100.0, cur->util * 100.0);
+        bad = 1;
+    }
+    if (slower(cur, base_ops, base_secs, base_hi, base_min, threshold)) {
+        printf("REGRESSION %s: throughput %.0f -> %.0f Kops "
+               "(95%% CI of secs %.6f-%.6f vs %.6f-%.6f)\n",
+               trace, base_kops, cur_kops,
+               base_lo, base_hi, cur->timing.ci_lo, cur->timing.ci_hi);
+        bad = 1;
+    }
+    return bad;
+}
+
+/*
+ * check_baseline - compare the mm results against a run stored with --csv
+ *    A trace that looks slower is timed up to RETIMES more times first:
+ *    its fastest median is kept, and the spread of the medians widens
+ *    the band it has to fall out of, since one slow run on a busy
+ *    machine is not a regression. Returns the number of regressions.
+ */
+static int check_baseline(char *path, double threshold, char **tracefiles,
+                          int n, stats_t *mm_stats, double perfindex)
+{
+    FILE *fp;
+    char line[MAXLINE];
+    char *f[64], *hdr[64];
+    int nhdr, nf, i, j, matched = 0, regressions = 0;
+    int c_alloc = -1, c_trace = -1, c_util = -1, c_ops = -1, c_secs = -1;
+    int c_lo = -1, c_hi = -1, c_min = -1, c_perf = -1;
+    double lo, hi;
+    stats_t total, *cur;
+    char hdrline[MAXLINE];
+
+    if ((fp = fopen(path, "r")) == NULL) {
+        sprintf(msg, "Could not open baseline %s", path);
+        unix_error(msg);
+    }
+
+    /* Find the columns we need by name */
+    if (fgets(hdrline, MAXLINE, fp) == NULL)
+        app_error("Empty baseline file");
+    nhdr = csv_split(hdrline, hdr, 64);
+    for (j = 0; j < nhdr; j++) {
+        if (!strcmp(hdr[j], "allocator")) c_alloc = j;
+        else if (!strcmp(hdr[j], "trace")) c_trace = j;
+        else if (!strcmp(hdr[j], "util")) c_util = j;
+        else if (!strcmp(hdr[j], "ops")) c_ops = j;
+        else if (!strcmp(hdr[j], "secs")) c_secs = j;
+        else if (!strcmp(hdr[j], "secs_min")) c_min = j;
+        else if (!strcmp(hdr[j], "secs_ci_lo")) c_lo = j;
+        else if (!strcmp(hdr[j], "secs_ci_hi")) c_hi = j;
+        else if (!strcmp(hdr[j], "perfindex")) c_perf = j;
+    }
+    if (c_alloc < 0 || c_trace < 0 || c_util < 0 || c_ops < 0 ||
+        c_secs < 0 || c_lo < 0 || c_hi < 0)
+        app_error("Baseline file is not a CSV written by --csv");
+
+    printf("Comparing against baseline %s (threshold %.1f%%)\n",
+           path, threshold * 100.0);
+
+    /* Re-time the traces that look slower before judging anything */
+    while (fgets(line, MAXLINE, fp) != NULL) {
+        nf = csv_split(line, f, 64);
+        if (nf < nhdr || strcmp(f[c_alloc], "mm"))
+            continue;
+        for (i = 0; i < n; i++) {
+            cur = &mm_stats[i];
+            if (strcmp(f[c_trace], tracefiles[i]) || !cur->valid)
+                continue;
+            lo = hi = cur->secs;
+            for (j = 0; j < RETIMES && slower(cur, atof(f[c_ops]), atof(f[c_secs]),
+                                              atof(f[c_hi]),
+                                              c_min >= 0 ? atof(f[c_min]) : 0,
+                                              threshold); j++) {
+                printf("Re-timing %s\n", tracefiles[i]);
+                retime(tracefiles[i], cur, &lo, &hi);
+            }
+        }
+    }
+    total_stats(n, mm_stats, &total);
+    rewind(fp);
+    if (fgets(line, MAXLINE, fp) == NULL)
+        app_error("Empty baseline file");
+
+    while (fgets(line, MAXLINE, fp) != NULL) {
+        nf = csv_split(line, f, 64);
+        if (nf < nhdr || strcmp(f[c_alloc], "mm"))
+            continue;
+
+        /* Find the matching trace of this run */
+        cur = NULL;
+        if (!strcmp(f[c_trace], "TOTAL")) {
+            cur = &total;
+        }
+        else {
+            for (i = 0; i < n; i++)
+                if (!strcmp(f[c_trace], tracefiles[i]))
+                    cur = &mm_stats[i];
+        }
+        if (cur == NULL)
+            continue;
+        matched++;
+        if (!cur->valid) {
+            printf("REGRESSION %s: no longer valid\n", f[c_trace]);
+            regressions++;
+            continue;
+        }
+
+        regressions += check_regression(f[c_trace], cur, atof(f[c_util]),
+                                        atof(f[c_ops]), atof(f[c_secs]),
+                                        c_min >= 0 ? atof(f[c_min]) : 0,
+                                        atof(f[c_lo]), atof(f[c_hi]),
+                                        threshold);
+
+        if (cur == &total && c_perf >= 0 && *f[c_perf] &&
+            perfindex < atof(f[c_perf]) * (1.0 - threshold)) {
+            printf("REGRESSION TOTAL: perf index %.1f -> %.1f\n",
+                   atof(f[c_perf]), perfindex);
+            regressions++;
+        }
+    }
+    fclose(fp);
+
+    if (matched == 0)
+        app_error("Baseline has no mm results for these traces");
+    printf("%d regression%s in %d compared rows\n",
+           regressions, (regressions == 1) ? "" : "s", matched);
+    return regressions;
+}
+
 /*
  * app_error - Report an arbitrary application error
  */
@@ -920,13 +2316,34 @@ void unix_error(char *msg)
     exit(1);
 }
 
+/*
+ * parse_size - Parse a byte count with an optional K, M, G or T suffix.
+ *    Returns 0 if str is not a valid size.
+ */
+static size_t parse_size(char *str)
+{
+    char *end;
+    unsigned long long n = strtoull(str, &end, 10);
+    int shift = 0;
+
+    switch (*end) {
+    case 'k': case 'K': shift = 10; end++; break;
+    case 'm': case 'M': shift = 20; end++; break;
+    case 'g': case 'G': shift = 30; end++; break;
+    case 't': case 'T': shift = 40; end++; break;
+    }
+    if (end == str || *end != '\0' || n > (SIZE_MAX >> shift))
+        return 0;
+    return (size_t)n << shift;
+}
+
 /*
  * malloc_error - Report an error returned by the mm_malloc package
  */
-void malloc_error(int tracenum, int opnum, char *msg)
+void malloc_error(int tracenum, long opnum, char *msg)
 {
     errors++;
-    printf("ERROR [trace %d, line %d]: %s\n", tracenum, LINENUM(opnum), msg);
+    printf("ERROR [trace %d, line %ld]: %s\n", tracenum, LINENUM(opnum), msg);
 }
 
 /*
@@ -934,14 +2351,41 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void)
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValCLP] [-f <file>] [-t <dir>] [-c <cpu>] [-F <n>] [-H <rate>]\n");
+    fprintf(stderr, "               [-m <size>] [-M <kind>] [-S <n>] [-W <frac>] [--json <file>] [--csv <file>] [--baseline <file> [--threshold <pct>]]\n");
+    fprintf(stderr, "               [--ci <pct>] [--warmup <n>] [--samples <min>[,<max>]] [--budget <secs>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
+    fprintf(stderr, "\t-c <cpu>   Pin the driver to <cpu> while timing.\n");
+    fprintf(stderr, "\t-C         Also time each trace with cold caches.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-F <n>     Print a fragmentation timeline sampled every <n> ops.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-H <rate>  Sample the heap every <rate> bytes and dump a profile\n");
+    fprintf(stderr, "\t           of each trace's peak to <trace>.heap.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-L         Print per-op latency percentiles for mm malloc.\n");
+    fprintf(stderr, "\t-m <size>  Simulated heap limit, e.g. 512M or 64G (default %dM).\n",
+            MAX_HEAP >> 20);
+    fprintf(stderr, "\t-M <kind>  Back the heap with lazy (default) or commit memory, adding\n");
+    fprintf(stderr, "\t           prefault, huge or hugetlb, e.g. commit,huge (see memlib.c).\n");
+    fprintf(stderr, "\t-P         Collect hardware performance counters per trace.\n");
+    fprintf(stderr, "\t-S <n>     Soak: replay the traces <n> times on one heap and report drift.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
+    fprintf(stderr, "\t-W <frac>  Touch payloads, reading <frac> of the live blocks per op.\n");
+    fprintf(stderr, "\t--json <file>      Write all results as JSON.\n");
+    fprintf(stderr, "\t--csv <file>       Write all results as CSV.\n");
+    fprintf(stderr, "\t--baseline <file>  Compare with a run saved by --csv and exit\n");
+    fprintf(stderr, "\t                   with status 2 if util or throughput regressed;\n");
+    fprintf(stderr, "\t                   slower traces are re-timed before they count.\n");
+    fprintf(stderr, "\t--threshold <pct>  Regression allowed by --baseline (default 3).\n");
+    fprintf(stderr, "\t--ci <pct>         Sample a median until its 95%% CI is within\n");
+    fprintf(stderr, "\t                   <pct> of it (default 1).\n");
+    fprintf(stderr, "\t--warmup <n>       Untimed runs before sampling (default 2).\n");
+    fprintf(stderr, "\t--samples <min>[,<max>]\n");
+    fprintf(stderr, "\t                   Samples per median (default 10,500).\n");
+    fprintf(stderr, "\t--budget <secs>    Time allowed for one median (default 1).\n");
 }
@@ -3,35 +3,153 @@
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
  */
+#define _GNU_SOURCE  /* memfd_create */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
 #include <string.h>
 #include <errno.h>
 
 #include "memlib.h"
 #include "config.h"
 
+/* Backends: how a region's range is reserved and backed */
+enum {
+    MEM_LAZY,    /* MAP_NORESERVE, backed by the kernel on first touch */
+    MEM_COMMIT   /* PROT_NONE, committed with mprotect as brk advances */
+};
+
+#define COMMIT_GRAIN (1<<16)  /* bytes committed at a time (MEM_COMMIT) */
+#define HUGE_PAGE    (1<<21)  /* x86-64 and arm64 (4K granule) huge page */
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23 /* Linux 5.14 */
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << 26) /* MAP_HUGE_SHIFT */
+#endif
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000 /* Linux 4.17; a mere hint before */
+#endif
+
+#define FILE_MAGIC 0x50414548454c4946ULL /* "FILEHEAP": a mem_open file */
+
+/* One simulated heap: a reserved range and its brk pointer */
+struct mem {
+    char *start_brk;  /* points to first byte of heap */
+    char *brk;        /* points to last byte of heap */
+    char *max_addr;   /* largest legal heap address */
+    size_t max_heap;  /* size of the heap's range in bytes */
+    char *map;        /* start of the mapping (the region's mem_t, if any) */
+    size_t map_size;  /* length of the mapping */
+    char *commit;     /* end of the accessible part of the range */
+    int backend;      /* MEM_LAZY or MEM_COMMIT */
+    int prefault;     /* fault in newly committed pages at once? */
+    int pages;        /* MEM_PAGES_BASE, _THP or _HUGETLB */
+    int fd;           /* the file of a mem_open region (locked), else -1 */
+    uint64_t magic;   /* FILE_MAGIC in a mem_open region */
+};
+
 /* private variables */
-static char *mem_start_brk;  /* points to first byte of heap */
-static char *mem_brk;        /* points to last byte of heap */
-static char *mem_max_addr;   /* largest legal heap address */ 
+static mem_t mem_global;     /* the region behind mem_init, mem_sbrk, ... */
+static int mem_backend = MEM_LAZY; /* backend of regions made from now on */
+static int mem_prefault = 0;
+static int mem_pages = MEM_PAGES_BASE;
+
+/* function prototypes */
+static char *reserve(size_t *bytes, int *pages);
+static void setup(mem_t *m, char *map, size_t size, int pages, size_t hdr,
+                  size_t max_heap);
+static int commit_to(mem_t *m, char *addr);
+
+/*
+ * mem_set_backend - choose how the regions made by later calls to
+ *    mem_init and mem_create are backed. spec is a comma-separated list:
+ *
+ *      lazy      reserve with MAP_NORESERVE; pages are backed as they
+ *                are first touched (the default)
+ *      commit    reserve with PROT_NONE and commit (mprotect) the range
+ *                in COMMIT_GRAIN steps as the brk advances, so the
+ *                kernel accounts only what the heap uses
+ *      prefault  with commit, also fault in each newly committed step at
+ *                once, like MAP_POPULATE, so the heap never page-faults
+ *      huge      align the range to 2 MiB and ask for transparent huge
+ *                pages (MADV_HUGEPAGE)
+ *      hugetlb   map the range from the hugetlbfs pool (MAP_HUGETLB);
+ *                falls back to huge if the pool is too small
+ *
+ *    e.g. "commit,prefault,huge". Return 0, or -1 if spec is not valid.
+ */
+int mem_set_backend(const char *spec)
+{
+    char buf[64], *tok, *save;
+    int backend = MEM_LAZY, prefault = 0, pages = MEM_PAGES_BASE;
+
+    if (strlen(spec) >= sizeof(buf))
+        return -1;
+    strcpy(buf, spec);
+    for (tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        if (strcmp(tok, "lazy") == 0)
+            backend = MEM_LAZY;
+        else if (strcmp(tok, "commit") == 0)
+            backend = MEM_COMMIT;
+        else if (strcmp(tok, "prefault") == 0)
+            prefault = 1;
+        else if (strcmp(tok, "huge") == 0)
+            pages = MEM_PAGES_THP;
+        else if (strcmp(tok, "hugetlb") == 0)
+            pages = MEM_PAGES_HUGETLB;
+        else
+            return -1;
+    }
+    if (prefault && backend != MEM_COMMIT)
+        return -1;  /* a lazy 64G range cannot be populated up front */
+
+    mem_backend = backend;
+    mem_prefault = prefault;
+    mem_pages = pages;
+    return 0;
+}
+
+/*
+ * mem_set_pages - change only the page size of later regions (one of
+ *    MEM_PAGES_*) and return the previous setting
+ */
+int mem_set_pages(int pages)
+{
+    int old = mem_pages;
+
+    mem_pages = pages;
+    return old;
+}
 
 /* 
- * mem_init - initialize the memory system model
+ * mem_init - initialize the memory system model with room for a heap of
+ *    max_heap bytes (MAX_HEAP if 0). The range is only reserved (see
+ *    mem_set_backend), so very large limits cost nothing until they are
+ *    used.
  */
-void mem_init(void)
+void mem_init(size_t max_heap)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	   fprintf(stderr, "mem_init_vm: malloc error\n");
+    size_t size;
+    char *map;
+    int pages;
+
+    if (max_heap == 0)
+        max_heap = MAX_HEAP;
+
+    /* reserve the storage we will use to model the available VM */
+    size = max_heap;
+    if ((map = reserve(&size, &pages)) == NULL) {
+	   fprintf(stderr, "mem_init_vm: mmap error: %s\n", strerror(errno));
 	   exit(1);
     }
-
-    mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
-    mem_brk = mem_start_brk;                  /* heap is empty initially */
+    setup(&mem_global, map, size, pages, 0, max_heap);
 }
 
 /* 
@@ -39,7 +157,224 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    munmap(mem_global.map, mem_global.map_size);
+}
+
+/*
+ * mem_default - return the region that mem_init set up
+ */
+mem_t *mem_default(void)
+{
+    return &mem_global;
+}
+
+/*
+ * mem_create - reserve an independent region with room for max_heap
+ *    bytes (MAX_HEAP if 0). Its mem_t lives in the first page of the
+ *    mapping, so a region costs one mmap and is freed by one munmap.
+ *    Return NULL if the range cannot be reserved.
+ */
+mem_t *mem_create(size_t max_heap)
+{
+    size_t page = mem_pagesize();
+    size_t size;
+    char *map;
+    mem_t m;
+    int pages;
+
+    if (max_heap == 0)
+        max_heap = MAX_HEAP;
+    size = max_heap + page;
+    if ((map = reserve(&size, &pages)) == NULL)
+        return NULL;
+
+    /* set up a copy first: the header page may not be accessible yet */
+    setup(&m, map, size, pages, page, max_heap);
+    if (commit_to(&m, m.start_brk) < 0) {
+        munmap(map, size);
+        return NULL;
+    }
+    *(mem_t *)map = m;
+    return (mem_t *)map;
+}
+
+/*
+ * mem_destroy - unmap a region made by mem_create or mem_open
+ */
+void mem_destroy(mem_t *m)
+{
+    int fd = m->fd;
+
+    munmap(m->map, m->map_size);
+    if (fd >= 0)
+        close(fd);  /* and with it the lock */
+}
+
+/*
+ * mem_open - map a region from the file at path, so that the heap in it
+ *    outlives the process. A new (empty) file is sized for max_heap
+ *    bytes (MAX_HEAP if 0) and *created is set; an existing one keeps
+ *    its size and its brk. As with mem_create, the mem_t lives in the
+ *    first page, so the file holds everything needed to reopen it.
+ *
+ *    The region is mapped at base if that is not NULL, and otherwise
+ *    where it was mapped last time if that range is free, so callers
+ *    rarely need to relocate anything. The file is locked for as long
+ *    as the region is open. Return NULL (with errno set) if the file
+ *    cannot be opened, locked or mapped, or is not a region file.
+ */
+mem_t *mem_open(const char *path, size_t max_heap, void *base, int *created)
+{
+    size_t page = mem_pagesize();
+    size_t size, heapsize = 0;
+    struct stat st;
+    char *map, *last = NULL;
+    mem_t m;
+    int fd, err;
+
+    if ((fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) < 0)
+        return NULL;
+    if (flock(fd, LOCK_EX | LOCK_NB) < 0 || fstat(fd, &st) < 0)
+        goto fail;
+
+    *created = (st.st_size == 0);
+    if (*created) {
+        if (max_heap == 0)
+            max_heap = MAX_HEAP;
+        size = max_heap + page;
+        if (ftruncate(fd, size) < 0)   /* sparse: costs no disk yet */
+            goto fail;
+    } else {
+        if (pread(fd, &m, sizeof(m), 0) != sizeof(m) || m.magic != FILE_MAGIC ||
+            m.map_size != (size_t)st.st_size) {
+            errno = EINVAL;
+            goto fail;
+        }
+        size = m.map_size;
+        max_heap = m.max_heap;
+        heapsize = m.brk - m.start_brk;
+        if (base == NULL)
+            base = last = m.map;
+    }
+
+    map = mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED |
+               (base ? MAP_FIXED_NOREPLACE : 0), fd, 0);
+    if (map == MAP_FAILED && last != NULL)
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+        goto fail;
+    if (base != NULL && last == NULL && map != base) {
+        munmap(map, size);  /* the kernel took MAP_FIXED_NOREPLACE as a hint */
+        errno = EEXIST;
+        goto fail;
+    }
+
+    setup(&m, map, size, MEM_PAGES_BASE, page, max_heap);
+    m.backend = MEM_LAZY;     /* the file backs every page */
+    m.prefault = 0;
+    m.commit = m.max_addr;
+    m.brk = m.start_brk + heapsize;
+    m.fd = fd;
+    m.magic = FILE_MAGIC;
+    *(mem_t *)map = m;
+    return (mem_t *)map;
+
+ fail:
+    err = errno;
+    close(fd);
+    errno = err;
+    return NULL;
+}
+
+/*
+ * mem_share - map a region that several processes share: the POSIX
+ *    shared memory object name (see shm_open), or a new memfd if name
+ *    is NULL, which only children forked after the call can share. The
+ *    process that creates the object sizes it for max_heap bytes
+ *    (MAX_HEAP if 0) and gets *created set. The region is shared with
+ *    all its pointers, so every process maps it at the address its
+ *    creator chose; opening fails with EEXIST if that range is taken
+ *    here, and with ETIMEDOUT if the creator never finishes.
+ *
+ *    mem_sbrk_r on a shared region must be serialized by the caller.
+ */
+mem_t *mem_share(const char *name, size_t max_heap, int *created)
+{
+    size_t page = mem_pagesize();
+    struct stat st;
+    char *map;
+    mem_t m;
+    int fd, err, waited;
+
+    *created = 1;
+    if (name == NULL)
+        fd = memfd_create("mm-heap", MFD_CLOEXEC);
+    else if ((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0 &&
+             errno == EEXIST) {
+        *created = 0;
+        fd = shm_open(name, O_RDWR, 0);
+    }
+    if (fd < 0)
+        return NULL;
+
+    if (*created) {
+        if (max_heap == 0)
+            max_heap = MAX_HEAP;
+        if (ftruncate(fd, max_heap + page) < 0)
+            goto fail;
+        map = mmap(NULL, max_heap + page, PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED)
+            goto fail;
+        setup(&m, map, max_heap + page, MEM_PAGES_BASE, page, max_heap);
+        m.backend = MEM_LAZY;
+        m.prefault = 0;
+        m.commit = m.max_addr;
+        *(mem_t *)map = m;
+        /* publish: openers wait for the magic */
+        __atomic_store_n(&((mem_t *)map)->magic, FILE_MAGIC, __ATOMIC_RELEASE);
+    } else {
+        /* the creator may still be setting the object up */
+        for (waited = 0; ; waited++) {
+            if (fstat(fd, &st) < 0)
+                goto fail;
+            if ((size_t)st.st_size > page &&
+                pread(fd, &m, sizeof(m), 0) == sizeof(m) && m.magic == FILE_MAGIC)
+                break;
+            if (waited == SHARE_WAIT) {
+                errno = ETIMEDOUT;
+                goto fail;
+            }
+            usleep(1000);
+        }
+        map = mmap(m.map, m.map_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+        if (map == MAP_FAILED && errno != EEXIST)
+            goto fail;
+        if (map != m.map) {
+            if (map != MAP_FAILED)
+                munmap(map, m.map_size);
+            errno = EEXIST;
+            goto fail;
+        }
+    }
+    close(fd);  /* the mapping keeps the object */
+    return (mem_t *)map;
+
+ fail:
+    err = errno;
+    close(fd);
+    errno = err;
+    return NULL;
+}
+
+/*
+ * mem_sync_r - write the used part of a mem_open region back to its
+ *    file; return 0, or -1 if msync fails
+ */
+int mem_sync_r(mem_t *m)
+{
+    return msync(m->map, m->brk - m->map, MS_SYNC);
 }
 
 /*
@@ -47,7 +382,12 @@ void mem_deinit(void)
  */
 void mem_reset_brk()
 {
-    mem_brk = mem_start_brk;
+    mem_reset_brk_r(&mem_global);
+}
+
+void mem_reset_brk_r(mem_t *m)
+{
+    m->brk = m->start_brk;
 }
 
 /* 
@@ -55,16 +395,21 @@ void mem_reset_brk()
  *    by incr bytes and returns the start address of the new area. In
  *    this model, the heap cannot be shrunk.
  */
-void *mem_sbrk(int incr) 
+void *mem_sbrk(intptr_t incr) 
 {
-    char *old_brk = mem_brk;
+    return mem_sbrk_r(&mem_global, incr);
+}
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
-	   errno = ENOMEM;
-	   fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+void *mem_sbrk_r(mem_t *m, intptr_t incr)
+{
+    char *old_brk = m->brk;
+
+    if ( (incr < 0) || (incr > m->max_addr - m->brk) ||
+         (m->brk + incr > m->commit && commit_to(m, m->brk + incr) < 0)) {
+	   errno = ENOMEM;  /* silently, like sbrk: libmm.so is a drop-in malloc */
 	   return (void *)-1;
     }
-    mem_brk += incr;
+    m->brk += incr;
     return (void *)old_brk;
 }
 
@@ -73,7 +418,12 @@ void *mem_sbrk(int incr)
  */
 void *mem_heap_lo()
 {
-    return (void *)mem_start_brk;
+    return mem_heap_lo_r(&mem_global);
+}
+
+void *mem_heap_lo_r(mem_t *m)
+{
+    return (void *)m->start_brk;
 }
 
 /* 
@@ -81,7 +431,12 @@ void *mem_heap_lo()
  */
 void *mem_heap_hi()
 {
-    return (void *)(mem_brk - 1);
+    return mem_heap_hi_r(&mem_global);
+}
+
+void *mem_heap_hi_r(mem_t *m)
+{
+    return (void *)(m->brk - 1);
 }
 
 /*
@@ -89,7 +444,12 @@ void *mem_heap_hi()
  */
 size_t mem_heapsize() 
 {
-    return (size_t)(mem_brk - mem_start_brk);
+    return mem_heapsize_r(&mem_global);
+}
+
+size_t mem_heapsize_r(mem_t *m)
+{
+    return (size_t)(m->brk - m->start_brk);
 }
 
 /*
@@ -99,3 +459,115 @@ size_t mem_pagesize()
 {
     return (size_t)getpagesize();
 }
+
+/*
+ * mem_hugepage_r - returns the huge page size backing a region, or 0 if
+ *    it is backed by ordinary pages
+ */
+size_t mem_hugepage_r(mem_t *m)
+{
+    return (m->pages == MEM_PAGES_BASE) ? 0 : HUGE_PAGE;
+}
+
+/*
+ * reserve - map *bytes of address space for a region under the current
+ *    backend. On return *bytes is the length actually mapped (rounded up
+ *    for hugetlb) and *pages the page size that was obtained. Return
+ *    NULL if the kernel refuses.
+ */
+static char *reserve(size_t *bytes, int *pages)
+{
+    int prot = (mem_backend == MEM_COMMIT) ? PROT_NONE : PROT_READ | PROT_WRITE;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    size_t size, head;
+    char *map;
+
+    /* a PROT_NONE range is not charged until it is made writable, so
+       only a lazy range needs MAP_NORESERVE */
+    if (mem_backend == MEM_LAZY)
+        flags |= MAP_NORESERVE;
+    *pages = mem_pages;
+
+    if (*pages == MEM_PAGES_HUGETLB) {
+        size = (*bytes + HUGE_PAGE - 1) & ~(size_t)(HUGE_PAGE - 1);
+        map = mmap(NULL, size, prot, flags | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+        if (map != MAP_FAILED) {
+            *bytes = size;
+            return map;
+        }
+        fprintf(stderr, "mem: no hugetlb pages for %zu bytes (%s), "
+                "using transparent huge pages\n", size, strerror(errno));
+        *pages = MEM_PAGES_THP;
+    }
+
+    if (*pages == MEM_PAGES_BASE) {
+        map = mmap(NULL, *bytes, prot, flags, -1, 0);
+        return (map == MAP_FAILED) ? NULL : map;
+    }
+
+    /* THP: over-map by a huge page and trim both ends, so that the
+       range starts on a huge page boundary */
+    size = *bytes + HUGE_PAGE;
+    if ((map = mmap(NULL, size, prot, flags, -1, 0)) == MAP_FAILED)
+        return NULL;
+    head = (HUGE_PAGE - ((uintptr_t)map & (HUGE_PAGE - 1))) & (HUGE_PAGE - 1);
+    if (head > 0)
+        munmap(map, head);
+    munmap(map + head + *bytes, size - head - *bytes);
+    map += head;
+    /* only a hint: without THP the range simply keeps small pages */
+    madvise(map, *bytes, MADV_HUGEPAGE);
+    return map;
+}
+
+/*
+ * setup - fill in a region whose heap starts hdr bytes into a mapping of
+ *    size bytes at map
+ */
+static void setup(mem_t *m, char *map, size_t size, int pages, size_t hdr,
+                  size_t max_heap)
+{
+    m->map = map;
+    m->map_size = size;
+    m->start_brk = map + hdr;
+    m->max_heap = max_heap;
+    m->max_addr = m->start_brk + max_heap;  /* max legal heap address */
+    m->brk = m->start_brk;                  /* heap is empty initially */
+    m->backend = mem_backend;
+    m->prefault = mem_prefault;
+    m->pages = pages;
+    m->fd = -1;
+    m->magic = 0;
+    /* a lazy region is accessible throughout */
+    m->commit = (m->backend == MEM_COMMIT) ? map : m->max_addr;
+}
+
+/*
+ * commit_to - make the region accessible up to at least addr, in
+ *    COMMIT_GRAIN steps (whole huge pages on a huge page region); return
+ *    0, or -1 if the kernel refuses
+ */
+static int commit_to(mem_t *m, char *addr)
+{
+    size_t off = addr - m->map;
+    size_t grain = mem_hugepage_r(m) ? HUGE_PAGE : COMMIT_GRAIN;
+    size_t page = mem_pagesize();
+    char *end, *p;
+
+    end = m->map + (off + grain - 1) / grain * grain;
+    if (end > m->map + m->map_size)
+        end = m->map + m->map_size;
+    if (end <= m->commit)
+        return 0;
+
+    /* PROT_NONE pages were not charged; making them writable charges
+       them, as if they had been mapped without MAP_NORESERVE */
+    if (mprotect(m->commit, end - m->commit, PROT_READ | PROT_WRITE) < 0)
+        return -1;
+    if (m->prefault &&
+        madvise(m->commit, end - m->commit, MADV_POPULATE_WRITE) < 0)
+        for (p = m->commit; p < end; p += page)
+            *(volatile char *)p = 0;  /* kernels before 5.14 */
+    m->commit = end;
+    return 0;
+}
@@ -1,11 +1,41 @@
 #include <unistd.h>
+#include <stdint.h>
 
-void mem_init(void);               
+/* Milliseconds mem_share and mm_share wait for another process that is
+   still creating the shared region or heap */
+#define SHARE_WAIT 5000
+
+/* Page sizes a region can be backed with (see mem_set_backend) */
+enum { MEM_PAGES_BASE, MEM_PAGES_THP, MEM_PAGES_HUGETLB };
+
+int mem_set_backend(const char *spec);
+int mem_set_pages(int pages);
+void mem_init(size_t max_heap);
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+void *mem_sbrk(intptr_t incr);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
 size_t mem_pagesize(void);
 
+/*
+ * Independent regions. The functions above work on the region set up by
+ * mem_init (mem_default()); the _r variants take the region explicitly,
+ * so a process can hold several heaps at once.
+ */
+typedef struct mem mem_t;
+
+mem_t *mem_default(void);
+mem_t *mem_create(size_t max_heap);
+mem_t *mem_open(const char *path, size_t max_heap, void *base, int *created);
+mem_t *mem_share(const char *name, size_t max_heap, int *created);
+int mem_sync_r(mem_t *m);
+void mem_destroy(mem_t *m);
+void *mem_sbrk_r(mem_t *m, intptr_t incr);
+void mem_reset_brk_r(mem_t *m);
+void *mem_heap_lo_r(mem_t *m);
+void *mem_heap_hi_r(mem_t *m);
+size_t mem_heapsize_r(mem_t *m);
+size_t mem_hugepage_r(mem_t *m);
+
@@ -15,7 +15,8 @@
  *      -----------------------------------
  *
  * where s are the meaningful size bits and a/f is 1
- * if and only if the block is allocated.
+ * if and only if the block is allocated. Bit 1 is set on allocated
+ * blocks sampled by the heap profiler.
  * if the block is free, it has the following form:
  * ------------------------------------------
  * hdr(s:f)| next_free pointer| prev_free pointer| ftr(s:f)
@@ -35,6 +36,11 @@
  *
  * The allocated prologue and epilogue blocks are overhead that
  * eliminate edge conditions during coalescing.
+ *
+ * All of a heap's state is in an mm_heap_t. mm_malloc, mm_free and
+ * mm_realloc work on a default heap in memlib's mem_init region;
+ * mm_create makes further heaps, each in a region of its own, for the
+ * _r variants.
  */
 
 #include <stdio.h>
@@ -43,15 +49,24 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdbool.h>
+#include <limits.h>
+#include <errno.h>
+#include <pthread.h>
 
 #include "mm.h"
 #include "memlib.h"
+#include "heapprof.h"
 
 /* Basic constants and macros */
 #define WSIZE       8       /* word size (bytes) */
 #define DSIZE       16      /* doubleword size (bytes) */
 #define CHUNKSIZE  (1<<12)  /* initial heap size (bytes) */
 #define OVERHEAD    16      /* overhead of header and footer (bytes) */
+#define REALLOC_SLACK 4     /* realloc keeps up to 1/4 of the size, and at
+                               most a chunk, as room to grow */
+/* Largest request considered: no region is this big, and rounding it
+   up (with any alignment up to the same bound) cannot wrap around */
+#define MAX_REQUEST (PTRDIFF_MAX / 4)
 #define PREV_PTR
 #define NEXT_PTR
 
@@ -75,6 +90,10 @@
 #define GET_SIZE(p)  (GET(p) & ~0xf)
 #define GET_ALLOC(p) (GET(p) & 0x1)
 
+/* Bit 1 of an allocated block's header and footer: the heap profiler
+   holds a record for the block (see mm_sample_set_rate) */
+#define SAMPLED      0x2
+
 /* Given block ptr bp, compute address of its header and footer */
 #define HDRP(bp)       (PSUB(bp, WSIZE))
 #define FTRP(bp)       (PADD(bp, GET_SIZE(HDRP(bp)) - DSIZE))
@@ -84,125 +103,287 @@
 #define PREV_BLKP(bp)  (PSUB(bp, GET_SIZE((PSUB(bp, DSIZE)))))
 
 /* Next free block ptr and prev free block ptr*/
-#define GET_NEXT_FREE(bp) ((void *)GET((bp)))
-#define GET_PREV_FREE(bp) ((void *)(GET(PADD(bp, WSIZE))))
+#define GET_NEXT_FREE(bp) get_link(bp)
+#define GET_PREV_FREE(bp) get_link(PADD(bp, WSIZE))
 
 /* Setting next free block and previous free block of bp*/
-#define SET_NEXT_FREE(bp, val) (PUT(bp, (size_t)val))
-#define SET_PREV_FREE(bp, val) (PUT(PADD(bp, WSIZE), (size_t)val))
+#define SET_NEXT_FREE(bp, val) set_link(bp, val)
+#define SET_PREV_FREE(bp, val) set_link(PADD(bp, WSIZE), val)
+
+/* A free list link is stored as the offset of the block it points to
+   from the link itself (0 for NULL), so the list means the same thing
+   wherever the heap is mapped (see mm_open) */
+static inline void *get_link(void *p) {
+    size_t off = GET(p);
+
+    return off ? PADD(p, off) : NULL;
+}
+
+static inline void set_link(void *p, void *val) {
+    PUT(p, val ? (size_t)((char *)val - (char *)p) : 0);
+}
+
+/*
+ * Phase profiling (-DMM_PROFILE). MM_PROF_SCOPE(ph) at the top of a
+ * function charges the cycles until the function returns, minus those
+ * of the phases it calls, to ph. The scope ends through gcc's cleanup
+ * attribute, so every return path is covered. Without MM_PROFILE the
+ * macro expands to nothing.
+ */
+#ifdef MM_PROFILE
+#include "clock.h"
+
+#define PROF_DEPTH 16
+
+const char *mm_phase_names[MM_PH_NUM] = {
+    "find_fit", "place", "coalesce", "efl", "extend", "api"
+};
+
+static mm_profile_t prof;
+static int prof_stack[PROF_DEPTH]; /* phases currently entered */
+static int prof_top = -1;
+static unsigned long long prof_last; /* time of the last enter or exit */
+
+static inline int prof_enter(int ph) {
+    unsigned long long now = read_counter();
+
+    if (prof_top >= 0)
+        prof.cycles[prof_stack[prof_top]] += now - prof_last;
+    prof_stack[++prof_top] = ph;
+    prof.calls[ph]++;
+    prof_last = now;
+    return ph;
+}
+
+static inline void prof_exit(int *ph) {
+    unsigned long long now = read_counter();
+
+    prof.cycles[prof_stack[prof_top--]] += now - prof_last;
+    prof_last = now;
+}
+
+#define MM_PROF_SCOPE(ph) \
+    int mm_prof_scope_ __attribute__((cleanup(prof_exit), unused)) = prof_enter(ph)
+
+/*
+ * mm_profile_reset -- zeroes the phase counters
+ */
+void mm_profile_reset(void) {
+    memset(&prof, 0, sizeof(prof));
+}
+
+/*
+ * mm_profile_get -- copies out the phase counters
+ */
+void mm_profile_get(mm_profile_t *p) {
+    *p = prof;
+}
+#else
+#define MM_PROF_SCOPE(ph)
+#endif
+
+/*
+ * Event tracing (-DMM_TRACE). MM_TRACE_START(t) takes the start time of
+ * a call, and MM_TRACE_EVENT(op, t, addr, size) appends it to the
+ * thread's ring in mmtrace.h, with the number of free blocks find_fit
+ * has visited since. Without MM_TRACE both expand to nothing.
+ */
+#ifdef MM_TRACE
+#include "mmtrace.h"
+
+static __thread uint32_t trace_search; /* free blocks visited by find_fit */
+
+#define MM_TRACE_START(t) \
+    uint64_t t = read_counter(); uint32_t t##_search = trace_search
+#define MM_TRACE_EVENT(op, t, addr, size) \
+    mmtrace_event(op, t, addr, size, trace_search - t##_search)
+#define MM_TRACE_SEARCH() trace_search++
+#else
+#define MM_TRACE_START(t)
+#define MM_TRACE_EVENT(op, t, addr, size)
+#define MM_TRACE_SEARCH()
+#endif
+
+/* A heap: its memory region, first block and explicit free list */
+struct mm_heap {
+    mem_t *mem;        /* region the heap grows in */
+    void *heap_start;  /* pointer to first block */
+    void *head_free;   /* pointer to the first "free" block in EFL */
+
+    /* used only by heaps in a file (mm_open) */
+    uint64_t magic;    /* HEAP_MAGIC once the heap is laid out */
+    void *self;        /* where the heap was mapped when it was opened */
+    size_t root;       /* offset of the application's root object, or 0 */
+    int clean;         /* was the heap closed by mm_close? */
+
+    /* used only by heaps shared between processes (mm_share) */
+    int shared;           /* take lock around every mm_*_r call? */
+    pthread_mutex_t lock; /* process-shared and robust */
+};
+
+#define HEAP_MAGIC 0x3130504145484d4dULL /* "MMHEAP01" */
 
 /* Global variables */
 
-// Pointer to first block
-static void *heap_start = NULL;
+// The heap behind mm_init, mm_malloc, mm_free and mm_realloc
+static mm_heap_t default_heap;
 
-//Pointer to the first "free" block in EFL
-static void *head_free = NULL;
+// Heap profiler: mean bytes between samples (0 = off), and per thread,
+// the bytes left to allocate before the next sample and the rate they
+// were drawn at. With sampling off a thread still looks at sample_rate
+// every SAMPLE_RECHECK bytes, to notice it being turned on.
+#define SAMPLE_RECHECK (1L << 20)
+static size_t sample_rate = 0;
+static __thread long sample_left __attribute__((tls_model("initial-exec"))) = 0;
+static __thread size_t sample_drawn = 0;
 
 /* Function prototypes for internal helper routines */
 
-static bool check_heap(int lineno);
-static void print_heap();
+static bool check_heap(mm_heap_t *h, int lineno);
+static void print_heap(mm_heap_t *h);
 static void print_block(void *bp);
 static bool check_block(int lineno, void *bp);
-static void *extend_heap(size_t size);
-static void *find_fit(size_t asize);
-static void *coalesce(void *bp);
-static void print_efl();
-static void place(void *bp, size_t asize);
+static void *extend_heap(mm_heap_t *h, size_t size);
+static void *find_fit(mm_heap_t *h, size_t asize);
+static void *coalesce(mm_heap_t *h, void *bp);
+static void print_efl(mm_heap_t *h);
+static inline void split_block(void *bp, size_t size, size_t asize,
+                               size_t alloc1, size_t alloc2);
+static void place(mm_heap_t *h, void *bp, size_t asize);
+static void shrink_block(mm_heap_t *h, void *bp, size_t asize);
+static size_t realloc_room(size_t asize);
+static void trim_slack(mm_heap_t *h, void *bp, size_t asize);
+static size_t adjust_size(size_t size);
 static size_t max(size_t x, size_t y);
+static size_t min(size_t x, size_t y);
+static void *realloc_block(mm_heap_t *h, void *ptr, size_t size);
+static void sample_block(mm_heap_t *h, void *bp, size_t size);
+static bool heap_recover(mm_heap_t *h);
+static int heap_lock(mm_heap_t *h);
+static void heap_unlock(mm_heap_t *h);
+
+
+/* Size of the mm_heap_t at the start of a heap made by mm_create */
+#define HEAP_HDR (DSIZE * ((sizeof(mm_heap_t) + DSIZE - 1) / DSIZE))
 
+/* The public entry points for the default heap and for mm_create'd heaps
+   share these bodies. They are forced inline so that sample_block always
+   sits one frame below the public function the application called. */
+#define HEAP_INLINE static inline __attribute__((always_inline))
+
+/*
+ * alloc_block -- finds or makes a free block of asize bytes in h and
+ * allocates it; returns NULL if the heap cannot grow
+ */
+HEAP_INLINE void *alloc_block(mm_heap_t *h, size_t asize) {
+    char *bp;
+
+    /* Search the free list for a fit */
+    if ((bp = find_fit(h, asize)) == NULL) {
+        /* No fit found. Get more memory and place the block */
+        if ((bp = extend_heap(h, max(asize, CHUNKSIZE) / WSIZE)) == NULL)
+            return NULL;
+    }
+    place(h, bp, asize);
+    return bp;
+}
+
+/*
+ * release_block -- marks the allocated block bp free and coalesces it
+ */
+HEAP_INLINE void release_block(mm_heap_t *h, void *bp) {
+    size_t size = GET_SIZE(HDRP(bp));
+
+    PUT(HDRP(bp), PACK(size, 0));
+    PUT(FTRP(bp), PACK(size, 0));
+    coalesce(h, bp);
+}
 
- /* mm_init - initalizes the heap;
-  * takes no arguments, return 0 if heap was initialized successfully, returns -1 otherwise;
+ /* heap_init - initalizes the heap h, whose region must be empty;
+  * return 0 if heap was initialized successfully, returns -1 otherwise;
   */
-int mm_init(void) {
+HEAP_INLINE int heap_init(mm_heap_t *h) {
+    MM_PROF_SCOPE(MM_PH_API);
+    MM_TRACE_START(t);
+
     /* create the initial empty heap */
-    if ((heap_start = mem_sbrk(4 * WSIZE)) == NULL)
+    if ((h->heap_start = mem_sbrk_r(h->mem, 4 * WSIZE)) == (void *)-1)
         return -1;
 
-    head_free = NULL;
+    h->head_free = NULL;
 
-    PUT(heap_start, 0);                        /* alignment padding */
-    PUT(PADD(heap_start, WSIZE), PACK(OVERHEAD, 1));  /* prologue header */
-    PUT(PADD(heap_start, DSIZE), PACK(OVERHEAD, 1));  /* prologue footer */
-    PUT(PADD(heap_start, WSIZE + DSIZE), PACK(0, 1));   /* epilogue header */
+    PUT(h->heap_start, 0);                        /* alignment padding */
+    PUT(PADD(h->heap_start, WSIZE), PACK(OVERHEAD, 1));  /* prologue header */
+    PUT(PADD(h->heap_start, DSIZE), PACK(OVERHEAD, 1));  /* prologue footer */
+    PUT(PADD(h->heap_start, WSIZE + DSIZE), PACK(0, 1));   /* epilogue header */
 
-    heap_start = PADD(heap_start, DSIZE); /* start the heap at the (size 0) payload of the prologue block */
+    h->heap_start = PADD(h->heap_start, DSIZE); /* start the heap at the (size 0) payload of the prologue block */
     /* Extend the empty heap with a free block of CHUNKSIZE bytes */
-    if (extend_heap(CHUNKSIZE / WSIZE) == NULL)
+    if (extend_heap(h, CHUNKSIZE / WSIZE) == NULL)
         return -1;
 
+    MM_TRACE_EVENT(MMTRACE_INIT, t, h->heap_start, mem_heapsize_r(h->mem));
     return 0;
 }
 
 /*
- * mm_malloc -- allocates memory in heap
+ * heap_malloc -- allocates memory in heap h
  * takes the number of bytes the user wants to alocate as an argument
  */
-void *mm_malloc(size_t size) {
-    size_t asize;      /* adjusted block size */
-    size_t extendsize; /* amount to extend heap if no fit */
+HEAP_INLINE void *heap_malloc(mm_heap_t *h, size_t size) {
+    MM_PROF_SCOPE(MM_PH_API);
+    MM_TRACE_START(t);
     char *bp;
 
     /* Ignore spurious requests */
-    if (size <= 0)
+    if (size <= 0 || size > MAX_REQUEST)
         return NULL;
 
     /* Adjust block size to include overhead and alignment reqs. */
-    if (size <= DSIZE) {
-        asize = DSIZE + OVERHEAD;
-    } else {
-        /* Add overhead and then round up to nearest multiple of double-word alignment */
-        asize = DSIZE * ((size + (OVERHEAD) + (DSIZE - 1)) / DSIZE);
-    }
-
-    /* Search the free list for a fit */
-    if ((bp = find_fit(asize)) != NULL) {
-        place(bp, asize);
-        return bp;
-    }
-
-    /* No fit found. Get more memory and place the block */
-    extendsize = max(asize, CHUNKSIZE);
-    if ((bp = extend_heap(extendsize / WSIZE)) == NULL)
+    if ((bp = alloc_block(h, adjust_size(size))) == NULL)
         return NULL;
-    place(bp, asize);
 
+    /* The only profiler cost on the common path */
+    if ((sample_left -= size) <= 0)
+        sample_block(h, bp, size);
+
+    MM_TRACE_EVENT(MMTRACE_MALLOC, t, bp, size);
     return bp;
 }
 
 
 /*
- * add_efl - adds a block the the explicit free list;
+ * add_efl - adds a block the the explicit free list of h;
  * takes a block pointer bp as an argument;
  * bp must be unallocated;
 */
-static void add_efl(void *bp){
+static void add_efl(mm_heap_t *h, void *bp){
+    MM_PROF_SCOPE(MM_PH_EFL);
 
-    if (head_free == NULL){
-        head_free = bp;
-        SET_NEXT_FREE(head_free, NULL);
-        SET_PREV_FREE(head_free, NULL);
+    if (h->head_free == NULL){
+        h->head_free = bp;
+        SET_NEXT_FREE(h->head_free, NULL);
+        SET_PREV_FREE(h->head_free, NULL);
     }
     else{
-        SET_NEXT_FREE(bp, head_free); //insert from the head
-        SET_PREV_FREE(head_free, bp);
+        SET_NEXT_FREE(bp, h->head_free); //insert from the head
+        SET_PREV_FREE(h->head_free, bp);
         SET_PREV_FREE(bp, NULL);
-        head_free = bp;  // update head_free to show new head as the bp
+        h->head_free = bp;  // update head_free to show new head as the bp
     }
 }
 
 /*
- * remove_efl - removes a block from EFL;
+ * remove_efl - removes a block from the EFL of h;
  * takes a block pointer bp as an argument
  * bp must be in EFL
 */
-static void remove_efl(void*bp){
-    if (bp == head_free){
-        head_free = GET_NEXT_FREE(bp);
-        if (head_free != NULL){ //if there were other elements in EFL
-            SET_PREV_FREE(head_free, NULL);
+static void remove_efl(mm_heap_t *h, void*bp){
+    MM_PROF_SCOPE(MM_PH_EFL);
+    if (bp == h->head_free){
+        h->head_free = GET_NEXT_FREE(bp);
+        if (h->head_free != NULL){ //if there were other elements in EFL
+            SET_PREV_FREE(h->head_free, NULL);
         }
     }
 
@@ -217,20 +398,944 @@ static void remove_efl(void*bp){
 }
 
 /*
- * mm_free -- unallocates the pointer;
+ * heap_free -- unallocates the pointer;
  * takes a block pointer bp as an argument;
- * bp must be allocated and in EFL;
+ * bp must be allocated in h;
+ */
+HEAP_INLINE void heap_free(mm_heap_t *h, void *bp) {
+    MM_PROF_SCOPE(MM_PH_API);
+    MM_TRACE_START(t);
+	size_t size = GET_SIZE(HDRP(bp));
+
+	if (GET(HDRP(bp)) & SAMPLED)
+	    heapprof_drop(bp);
+	PUT(HDRP(bp), PACK(size, 0));
+	PUT(FTRP(bp), PACK(size, 0));
+	coalesce(h, bp);
+	MM_TRACE_EVENT(MMTRACE_FREE, t, bp, size);
+
+}
+
+/*
+ * heap_realloc -- changes the size of an allocated block;
+ * takes a block pointer ptr and the new payload size as arguments;
+ * the block is resized in place when possible (shrinking, absorbing a free
+ * next block, or growing the heap when ptr is the last block), otherwise
+ * the payload is moved to a newly allocated block.
+ * For the heap profiler, a resize is a free of the old block followed by
+ * an allocation of size bytes. A realloc that fails, or that leaves both
+ * the block and the size as they were, keeps the old record.
+ */
+HEAP_INLINE void *heap_realloc(mm_heap_t *h, void *ptr, size_t size) {
+    MM_PROF_SCOPE(MM_PH_API);
+    void *newp;
+    int sampled;
+    MM_TRACE_START(t);
+
+    if (ptr == NULL)
+        return heap_malloc(h, size);
+
+    if (size == 0) {
+        heap_free(h, ptr);
+        return NULL;
+    }
+    if (size > MAX_REQUEST)
+        return NULL;  /* ptr is left as it was */
+
+    /* a block that moves is freed by heap_free, which drops its record */
+    sampled = (GET(HDRP(ptr)) & SAMPLED) != 0;
+    if ((newp = realloc_block(h, ptr, size)) != NULL) {
+        if (newp == ptr && sampled && heapprof_size(ptr) == size) {
+            /* same block, same size: keep the record (a trimmed
+               header lost the bit) */
+            PUT(HDRP(ptr), GET(HDRP(ptr)) | SAMPLED);
+            PUT(FTRP(ptr), GET(FTRP(ptr)) | SAMPLED);
+        }
+        else {
+            if (newp == ptr && sampled) {
+                heapprof_drop(ptr);
+                PUT(HDRP(ptr), GET(HDRP(ptr)) & ~SAMPLED);
+                PUT(FTRP(ptr), GET(FTRP(ptr)) & ~SAMPLED);
+            }
+            if ((sample_left -= size) <= 0)
+                sample_block(h, newp, size);
+        }
+    }
+    MM_TRACE_EVENT(MMTRACE_REALLOC, t, newp, size);
+    return newp;
+}
+
+/*
+ * heap_memalign -- allocates size bytes in h at a multiple of align (a
+ * power of two). The block is carved out of a larger one: the leading
+ * fragment is freed again, and so is the tail if it is big enough.
  */
+static void *heap_memalign(mm_heap_t *h, size_t align, size_t size) {
+    size_t asize, total, lead;
+    char *bp, *p;
+
+    if (align <= DSIZE)
+        return heap_malloc(h, size);
+    if (size == 0 || size > MAX_REQUEST || align > MAX_REQUEST ||
+        (align & (align - 1)) != 0)
+        return NULL;
+
+    asize = adjust_size(size);
+    total = asize + align + DSIZE + OVERHEAD;
+    if ((bp = alloc_block(h, total)) == NULL)
+        return NULL;
+    total = GET_SIZE(HDRP(bp));
+
+    /* the leading fragment must be empty or big enough to be a block */
+    p = (char *)(((size_t)bp + align - 1) & ~(align - 1));
+    if (p != bp && (size_t)(p - bp) < DSIZE + OVERHEAD)
+        p += align;
+    if ((lead = p - bp) > 0) {
+        split_block(bp, total, lead, 1, 1);
+        release_block(h, bp);
+    }
+    shrink_block(h, p, asize);
+    return p;
+}
+
+/*
+ * heap_drop_samples -- forgets the heap profiler records of h's blocks,
+ * before h is emptied, unmapped or closed
+ */
+static void heap_drop_samples(mm_heap_t *h) {
+    char *bp;
+
+    if (heapprof_count() == 0)
+        return;
+    for (bp = h->heap_start; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp))
+        if (GET(HDRP(bp)) & SAMPLED) {
+            heapprof_drop(bp);
+            PUT(HDRP(bp), GET(HDRP(bp)) & ~SAMPLED);
+            PUT(FTRP(bp), GET(FTRP(bp)) & ~SAMPLED);
+        }
+}
+
+ /* mm_init - initalizes the default heap in the region of mem_init,
+  * which the caller has reset with mem_reset_brk;
+  * return 0 if heap was initialized successfully, returns -1 otherwise;
+  */
+int mm_init(void) {
+    default_heap.mem = mem_default();
+    heapprof_clear();
+    return heap_init(&default_heap);
+}
+
+/*
+ * mm_malloc, mm_free, mm_realloc -- the heap_* routines on the default heap
+ */
+void *mm_malloc(size_t size) {
+    return heap_malloc(&default_heap, size);
+}
+
 void mm_free(void *bp) {
+    heap_free(&default_heap, bp);
+}
+
+void *mm_realloc(void *ptr, size_t size) {
+    return heap_realloc(&default_heap, ptr, size);
+}
+
+/*
+ * mm_create -- makes an independent heap in its own region of up to
+ * max_heap bytes (MAX_HEAP if 0); the mm_heap_t is the first thing in the
+ * region. Returns NULL if the region cannot be reserved.
+ */
+mm_heap_t *mm_create(size_t max_heap) {
+    mem_t *mem;
+    mm_heap_t *h;
+
+    if ((mem = mem_create(max_heap)) == NULL)
+        return NULL;
+    h = mem_sbrk_r(mem, HEAP_HDR);
+    h->mem = mem;
+    if (heap_init(h) < 0) {
+        mem_destroy(mem);
+        return NULL;
+    }
+    return h;
+}
+
+/*
+ * mm_destroy -- releases h and every block in it at once
+ */
+void mm_destroy(mm_heap_t *h) {
+    heap_drop_samples(h);
+    mem_destroy(h->mem);
+}
+
+/*
+ * mm_reset -- frees every block in h, leaving it as mm_create made it;
+ * returns 0, or -1 if the heap could not be laid out again
+ */
+int mm_reset(mm_heap_t *h) {
+    mem_t *mem = h->mem;
+
+    heap_drop_samples(h);
+    mem_reset_brk_r(mem);
+    mem_sbrk_r(mem, HEAP_HDR); /* h itself, left as it was */
+    return heap_init(h);
+}
+
+/*
+ * mm_open -- opens the heap in the file at path, creating it with room
+ * for max_heap bytes (MAX_HEAP if 0) if the file is new or empty. The
+ * heap is mapped at base if that is not NULL (see mem_open). An existing
+ * heap is used as it is: the free list links are relative, so a heap
+ * mapped at a new address only needs its two pointers moved. A heap
+ * that was not closed with mm_close is first rebuilt and checked by
+ * heap_recover. Returns NULL with errno set if the file cannot be
+ * mapped (EINVAL: not a heap, EIO: damaged beyond recovery).
+ */
+mm_heap_t *mm_open(const char *path, size_t max_heap, void *base) {
+    mem_t *mem;
+    mm_heap_t *h;
+    int created, clean;
+
+    if ((mem = mem_open(path, max_heap, base, &created)) == NULL)
+        return NULL;
+
+    if (created) {
+        h = mem_sbrk_r(mem, HEAP_HDR);
+        h->mem = mem;
+        h->root = 0;
+        if (heap_init(h) < 0) {
+            mem_destroy(mem);
+            return NULL;
+        }
+        h->magic = HEAP_MAGIC;  /* last: a torn creation is not a heap */
+        h->clean = 1;
+        h->self = h;
+    }
+    h = mem_heap_lo_r(mem);
+    if (h->magic != HEAP_MAGIC) {
+        mem_destroy(mem);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    /* mark the heap dirty before touching it, so that a crash from here
+       on is repaired by the next mm_open */
+    clean = h->clean;
+    h->clean = 0;
+    h->mem = mem;
+    h->heap_start = PADD(h, HEAP_HDR + DSIZE);
+    if (h->head_free != NULL)
+        h->head_free = PADD(h->head_free, (char *)h - (char *)h->self);
+    h->self = h;
+    if (!clean && !heap_recover(h)) {
+        mem_destroy(mem);
+        errno = EIO;
+        return NULL;
+    }
+    return h;
+}
+
+/*
+ * mm_sync -- writes h back to its file, leaving it open; returns 0, or
+ * -1 if the write failed
+ */
+int mm_sync(mm_heap_t *h) {
+    return mem_sync_r(h->mem);
+}
+
+/*
+ * mm_close -- marks h clean, writes it back to its file and unmaps it;
+ * returns 0, or -1 if the write failed (the heap is closed either way,
+ * and will be recovered when it is next opened)
+ */
+int mm_close(mm_heap_t *h) {
+    mem_t *mem = h->mem;
+    int ret;
+
+    heap_drop_samples(h);
+    if ((ret = mem_sync_r(mem)) == 0) {
+        h->clean = 1;   /* only once everything else is on disk */
+        ret = mem_sync_r(mem);
+    }
+    mem_destroy(mem);
+    return ret;
+}
+
+/*
+ * mm_root, mm_set_root -- the application's root object in h: the one
+ * block it can find again after mm_open, from which everything else it
+ * keeps in the heap is reached. Pointers kept inside a heap that may be
+ * mapped elsewhere must be offsets too (e.g. from the root).
+ */
+void *mm_root(mm_heap_t *h) {
+    return h->root ? PADD(h, h->root) : NULL;
+}
+
+void mm_set_root(mm_heap_t *h, void *p) {
+    h->root = p ? (size_t)((char *)p - (char *)h) : 0;
+}
+
+/*
+ * mm_share -- makes or joins a heap that several processes share, in
+ * the POSIX shared memory object name, or in a memfd that only children
+ * forked afterwards can use if name is NULL (see mem_share). The
+ * creator lays it out for max_heap bytes (MAX_HEAP if 0); the others
+ * wait for it. Every mm_*_r call on the heap then takes its lock, so
+ * blocks can be allocated in one process and freed in another, and
+ * mm_root hands them over. Returns NULL with errno set on failure.
+ */
+mm_heap_t *mm_share(const char *name, size_t max_heap) {
+    pthread_mutexattr_t attr;
+    mem_t *mem;
+    mm_heap_t *h;
+    int created, waited;
+
+    if ((mem = mem_share(name, max_heap, &created)) == NULL)
+        return NULL;
+
+    if (created) {
+        h = mem_sbrk_r(mem, HEAP_HDR);
+        h->mem = mem;
+        h->root = 0;
+        h->shared = 1;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&h->lock, &attr);
+        pthread_mutexattr_destroy(&attr);
+        if (heap_init(h) < 0) {
+            mem_destroy(mem);
+            return NULL;
+        }
+        __atomic_store_n(&h->magic, HEAP_MAGIC, __ATOMIC_RELEASE);
+        return h;
+    }
+
+    /* the creator may still be laying the heap out */
+    h = mem_heap_lo_r(mem);
+    for (waited = 0; __atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != HEAP_MAGIC; waited++) {
+        if (waited == SHARE_WAIT) {
+            mem_destroy(mem);
+            errno = ETIMEDOUT;
+            return NULL;
+        }
+        usleep(1000);
+    }
+    return h;
+}
+
+/*
+ * mm_detach -- unmaps a shared heap from this process; the heap lives
+ * on in the others (and, if it has a name, until shm_unlink)
+ */
+void mm_detach(mm_heap_t *h) {
+    mem_destroy(h->mem);
+}
+
+/*
+ * heap_lock, heap_unlock -- serialize the processes that share h (no-ops
+ * for other heaps). The lock is robust: if its owner died in the middle
+ * of an update, the next process to take it repairs the heap with
+ * heap_recover, or, if the blocks themselves are damaged, leaves the
+ * lock unrecoverable so that every later call fails. heap_lock returns
+ * 0, or -1 with errno set if the heap cannot be used.
+ */
+static int heap_lock(mm_heap_t *h) {
+    int err;
+
+    if (!h->shared)
+        return 0;
+    if ((err = pthread_mutex_lock(&h->lock)) == EOWNERDEAD) {
+        if (!heap_recover(h)) {
+            pthread_mutex_unlock(&h->lock);
+            errno = EIO;
+            return -1;
+        }
+        pthread_mutex_consistent(&h->lock);
+    } else if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+static void heap_unlock(mm_heap_t *h) {
+    if (h->shared)
+        pthread_mutex_unlock(&h->lock);
+}
+
+/*
+ * heap_recover -- repairs h after it was left in the middle of an update
+ * (not closed by mm_close, or its lock holder died): walks the blocks,
+ * finishing torn splits, frees and extensions and dropping stale
+ * profiler bits, rebuilds the free list, and validates the result with
+ * check_heap; returns false if the blocks themselves are damaged
+ */
+static bool heap_recover(mm_heap_t *h) {
+    char *end = (char *)mem_heap_hi_r(h->mem) + 1;
+    char *bp, *last_free = NULL;
+    size_t size;
+
+    h->head_free = NULL;
+    for (bp = h->heap_start; ; bp = NEXT_BLKP(bp)) {
+        size = GET_SIZE(HDRP(bp));
+        if (size == 0 && bp < end) {
+            /* extend_heap got the space but did not lay it out */
+            size = end - bp;
+            PUT(HDRP(bp), PACK(size, 0));
+        }
+        if (size == 0)
+            break;
+        if (size % DSIZE != 0 || size > (size_t)(end - bp))
+            return false;
+
+        /* headers are written last (split_block, coalesce), so they win */
+        PUT(HDRP(bp), GET(HDRP(bp)) & ~SAMPLED);
+        PUT(FTRP(bp), GET(HDRP(bp)));
+        if (GET_ALLOC(HDRP(bp)))
+            last_free = NULL;
+        else if (last_free != NULL) {
+            /* freed but not yet coalesced */
+            size += GET_SIZE(HDRP(last_free));
+            PUT(HDRP(last_free), PACK(size, 0));
+            PUT(FTRP(last_free), PACK(size, 0));
+            bp = last_free;
+        } else {
+            add_efl(h, bp);
+            last_free = bp;
+        }
+    }
+    PUT(HDRP(bp), PACK(0, 1));  /* the epilogue */
+    return check_heap(h, __LINE__);
+}
+
+/*
+ * mm_malloc_r, mm_free_r, mm_realloc_r -- the heap_* routines on heap h
+ */
+void *mm_malloc_r(mm_heap_t *h, size_t size) {
+    void *p;
+
+    if (heap_lock(h) < 0)
+        return NULL;
+    p = heap_malloc(h, size);
+    heap_unlock(h);
+    return p;
+}
+
+void mm_free_r(mm_heap_t *h, void *bp) {
+    if (heap_lock(h) < 0)
+        return;
+    heap_free(h, bp);
+    heap_unlock(h);
+}
+
+void *mm_realloc_r(mm_heap_t *h, void *ptr, size_t size) {
+    void *p;
+
+    if (heap_lock(h) < 0)
+        return NULL;
+    p = heap_realloc(h, ptr, size);
+    heap_unlock(h);
+    return p;
+}
 
-	PUT(HDRP(bp), PACK(GET_SIZE(HDRP(bp)), 0));
-	PUT(FTRP(bp), PACK(GET_SIZE(FTRP(bp)), 0));
-	coalesce(bp);
+/*
+ * mm_usable_size -- bytes of payload in the allocated block ptr, which
+ * may be more than were asked for
+ */
+size_t mm_usable_size(void *ptr) {
+    return GET_SIZE(HDRP(ptr)) - OVERHEAD;
+}
+
+/*
+ * mm_memalign, mm_memalign_r -- allocate size bytes at a multiple of
+ * align (a power of two) in the default heap or in h; the block is freed
+ * with mm_free or mm_free_r like any other
+ */
+void *mm_memalign(size_t align, size_t size) {
+    return heap_memalign(&default_heap, align, size);
+}
+
+void *mm_memalign_r(mm_heap_t *h, size_t align, size_t size) {
+    void *p;
+
+    if (heap_lock(h) < 0)
+        return NULL;
+    p = heap_memalign(h, align, size);
+    heap_unlock(h);
+    return p;
+}
 
+/*
+ * mm_sample_set_rate -- turns the sampling heap profiler on, taking on
+ * average one sample every rate bytes allocated, or off if rate is 0.
+ * Records of blocks that are still live are kept either way.
+ */
+void mm_sample_set_rate(size_t rate) {
+    __atomic_store_n(&sample_rate, rate, __ATOMIC_RELAXED);
+    sample_drawn = rate;
+    sample_left = rate ? (long)heapprof_next_interval(rate) : SAMPLE_RECHECK;
+}
+
+/*
+ * mm_sample_summary -- number of live sampled blocks and the live bytes
+ * they stand for
+ */
+void mm_sample_summary(size_t *samples, double *est_bytes) {
+    heapprof_summary(samples, est_bytes);
+}
+
+/*
+ * mm_sample_dump -- writes the live heap profile to fp (pprof legacy
+ * heap format); returns the number of distinct call stacks
+ */
+int mm_sample_dump(FILE *fp) {
+    return heapprof_dump(fp, __atomic_load_n(&sample_rate, __ATOMIC_RELAXED));
+}
+
+/*
+ * mm_heapinfo_r -- walks heap h and summarizes allocated and free blocks;
+ * takes a pointer to the mm_heapinfo_t to fill in.
+ * The prologue and epilogue are not counted.
+ */
+void mm_heapinfo_r(mm_heap_t *h, mm_heapinfo_t *info) {
+    char *bp;
+    size_t size;
+
+    memset(info, 0, sizeof(*info));
+    if (heap_lock(h) < 0)
+        return;
+    for (bp = NEXT_BLKP(h->heap_start); GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+        size = GET_SIZE(HDRP(bp));
+        if (GET_ALLOC(HDRP(bp))) {
+            info->alloc_blocks++;
+            info->alloc_bytes += size;
+        } else {
+            info->free_blocks++;
+            info->free_bytes += size;
+            info->largest_free = max(info->largest_free, size);
+        }
+    }
+    heap_unlock(h);
+}
+
+/*
+ * mm_heapinfo -- mm_heapinfo_r on the default heap
+ */
+void mm_heapinfo(mm_heapinfo_t *info) {
+    mm_heapinfo_r(&default_heap, info);
+}
+
+/*
+ * Arenas. An arena bump-allocates from chunks, which are ordinary
+ * allocated blocks of its heap. Objects are never freed one by one:
+ * mm_arena_reset and mm_arena_destroy hand whole chunks back to the free
+ * list, one coalesce per chunk. The mm_arena_t is a small block of its
+ * own in the same heap.
+ */
+
+/* Default chunk payload, and the largest request served from a shared
+   chunk (anything bigger gets a chunk of its own) */
+#define ARENA_CHUNK  (1<<16)
+#define ARENA_BIG(a) ((a)->chunk_size / 4)
+
+/* Start of every chunk's payload; objects follow it */
+typedef struct arena_chunk {
+    struct arena_chunk *next; /* chunks of the arena, newest first */
+    size_t size;              /* bytes available for objects */
+} arena_chunk_t;
+
+#define CHUNK_HDR (DSIZE * ((sizeof(arena_chunk_t) + DSIZE - 1) / DSIZE))
+
+struct mm_arena {
+    mm_heap_t *h;             /* heap the chunks come from */
+    arena_chunk_t *chunks;    /* list of chunks, the current one first */
+    char *cur;                /* next free byte in the current chunk, or
+                                 NULL if there is none yet */
+    char *end;                /* end of the current chunk */
+    size_t chunk_size;        /* object bytes in a regular chunk */
+};
+
+/*
+ * arena_chunk -- allocates a chunk with room for size bytes of objects.
+ * With current set, it becomes the head of the list and the chunk that
+ * objects are bumped from; otherwise it is linked in behind the head.
+ * Returns NULL if the heap is full.
+ */
+static arena_chunk_t *arena_chunk(mm_arena_t *a, size_t size, bool current) {
+    arena_chunk_t *c;
+
+    if ((c = alloc_block(a->h, adjust_size(CHUNK_HDR + size))) == NULL)
+        return NULL;
+    c->size = GET_SIZE(HDRP(c)) - OVERHEAD - CHUNK_HDR;
+    if (current) {
+        c->next = a->chunks;
+        a->chunks = c;
+        a->cur = PADD(c, CHUNK_HDR);
+        a->end = a->cur + c->size;
+    } else if (a->chunks == NULL) {
+        c->next = NULL;
+        a->chunks = c;
+    } else {
+        c->next = a->chunks->next;
+        a->chunks->next = c;
+    }
+    return c;
+}
+
+/*
+ * mm_arena_create -- makes an arena in heap h (the default heap if NULL)
+ * whose regular chunks hold chunk_size bytes (ARENA_CHUNK if 0);
+ * returns NULL if the heap is full
+ */
+mm_arena_t *mm_arena_create(mm_heap_t *h, size_t chunk_size) {
+    mm_arena_t *a;
+
+    if (h == NULL)
+        h = &default_heap;
+    if ((a = alloc_block(h, adjust_size(sizeof(mm_arena_t)))) == NULL)
+        return NULL;
+    a->h = h;
+    a->chunks = NULL;
+    a->cur = a->end = NULL;
+    a->chunk_size = chunk_size ? DSIZE * ((chunk_size + DSIZE - 1) / DSIZE)
+                               : ARENA_CHUNK;
+    return a;
+}
+
+/*
+ * mm_arena_alloc -- returns size bytes from arena a, 16-byte aligned,
+ * or NULL if the heap is full. The common case is a bounds check and a
+ * pointer bump.
+ */
+void *mm_arena_alloc(mm_arena_t *a, size_t size) {
+    arena_chunk_t *c;
+    char *p;
+
+    if (size > MAX_REQUEST)
+        return NULL;
+    /* a size of 0 still gets an object of its own: NULL means a full
+       heap, and the next object must not share the address */
+    size = (size == 0) ? DSIZE : DSIZE * ((size + DSIZE - 1) / DSIZE);
+    if (size <= (size_t)(a->end - a->cur)) {
+        p = a->cur;
+        a->cur += size;
+        return p;
+    }
+
+    /* Big requests get a chunk to themselves, so the current chunk is not
+       abandoned half full */
+    if (size > ARENA_BIG(a)) {
+        if ((c = arena_chunk(a, size, false)) == NULL)
+            return NULL;
+        return PADD(c, CHUNK_HDR);
+    }
+
+    if (arena_chunk(a, a->chunk_size, true) == NULL)
+        return NULL;
+    p = a->cur;
+    a->cur += size;
+    return p;
+}
+
+/*
+ * mm_arena_reset -- frees every object in arena a at once. The current
+ * chunk is kept for the objects that follow; the others go back to the
+ * heap's free list.
+ */
+void mm_arena_reset(mm_arena_t *a) {
+    arena_chunk_t *c, *next, *keep;
+
+    keep = (a->cur != NULL) ? a->chunks : NULL;
+    for (c = a->chunks; c != NULL; c = next) {
+        next = c->next;
+        if (c != keep)
+            release_block(a->h, c);
+    }
+    a->chunks = keep;
+    a->cur = a->end = NULL;
+    if (keep != NULL) {
+        keep->next = NULL;
+        a->cur = PADD(keep, CHUNK_HDR);
+        a->end = a->cur + keep->size;
+    }
+}
+
+/*
+ * mm_arena_destroy -- frees every object of arena a and the arena itself
+ */
+void mm_arena_destroy(mm_arena_t *a) {
+    arena_chunk_t *c, *next;
+
+    for (c = a->chunks; c != NULL; c = next) {
+        next = c->next;
+        release_block(a->h, c);
+    }
+    release_block(a->h, a);
+}
+
+/*
+ * Object pools. A pool hands out objects of one size from slabs: blocks
+ * of slab_size bytes (a power of two) aligned to slab_size, so the slab
+ * of an object is found by masking its address. Each slab keeps its
+ * free objects on an intrusive stack and carves fresh ones with a bump
+ * pointer; slabs with free objects are on the pool's partial list. A
+ * slab that empties goes back to the heap unless it is the pool's only
+ * empty slab, so a pool grows and shrinks a slab at a time.
+ */
+
+#define POOL_SLAB     (1<<14) /* smallest slab */
+#define POOL_MIN_OBJS 16      /* objects per slab, at least */
+
+typedef struct pool_slab {
+    mm_pool_t *pool;
+    struct pool_slab *next, *prev;   /* partial list */
+    struct pool_slab *anext, *aprev; /* all slabs */
+    void *free;                      /* stack of freed objects */
+    char *bump;                      /* next never-used object */
+    size_t used;                     /* live objects */
+} pool_slab_t;
+
+struct mm_pool {
+    mm_heap_t *h;          /* heap the slabs come from */
+    size_t obj_size;       /* object size, a multiple of the alignment */
+    size_t slab_size;      /* bytes per slab, also their alignment */
+    size_t first;          /* offset of the first object in a slab */
+    size_t per_slab;       /* objects per slab */
+    pool_slab_t *partial;  /* slabs with free objects */
+    pool_slab_t *all;      /* every slab */
+    size_t slabs;          /* number of slabs */
+    size_t empty;          /* slabs with no live objects */
+    size_t live;           /* live objects */
+};
+
+/* Link s into the doubly linked list at *head, through fields nx and pv */
+#define SLAB_PUSH(head, s, nx, pv) do {                   \
+        (s)->nx = *(head); (s)->pv = NULL;                \
+        if (*(head)) (*(head))->pv = (s);                 \
+        *(head) = (s);                                    \
+    } while (0)
+#define SLAB_UNLINK(head, s, nx, pv) do {                 \
+        if ((s)->pv) (s)->pv->nx = (s)->nx;               \
+        else *(head) = (s)->nx;                           \
+        if ((s)->nx) (s)->nx->pv = (s)->pv;               \
+    } while (0)
+
+/*
+ * mm_pool_create_r -- makes a pool of obj_size-byte objects aligned to
+ * align (a power of two; 16 if smaller) in heap h (the default heap if
+ * NULL); returns NULL if the arguments are bad or the heap is full
+ */
+mm_pool_t *mm_pool_create_r(mm_heap_t *h, size_t obj_size, size_t align) {
+    mm_pool_t *p;
+    size_t slab;
+
+    if (h == NULL)
+        h = &default_heap;
+    if (obj_size == 0 || obj_size > MAX_REQUEST / POOL_MIN_OBJS ||
+        align > MAX_REQUEST || (align & (align - 1)) != 0)
+        return NULL;
+    align = max(align, DSIZE);
+    obj_size = (max(obj_size, sizeof(void *)) + align - 1) & ~(align - 1);
+
+    for (slab = POOL_SLAB; slab < obj_size * POOL_MIN_OBJS + align + sizeof(pool_slab_t); slab *= 2)
+        ;
+    if ((p = alloc_block(h, adjust_size(sizeof(mm_pool_t)))) == NULL)
+        return NULL;
+    p->h = h;
+    p->obj_size = obj_size;
+    p->slab_size = slab;
+    p->first = (sizeof(pool_slab_t) + align - 1) & ~(align - 1);
+    p->per_slab = (slab - p->first) / obj_size;
+    p->partial = p->all = NULL;
+    p->slabs = p->empty = p->live = 0;
+    return p;
+}
+
+/*
+ * mm_pool_create -- mm_pool_create_r on the default heap
+ */
+mm_pool_t *mm_pool_create(size_t obj_size, size_t align) {
+    return mm_pool_create_r(NULL, obj_size, align);
+}
+
+/*
+ * mm_pool_alloc -- returns an object from pool p, or NULL if the heap
+ * is full
+ */
+void *mm_pool_alloc(mm_pool_t *p) {
+    pool_slab_t *s = p->partial;
+    void *obj;
+
+    if (s == NULL) {
+        if ((s = heap_memalign(p->h, p->slab_size, p->slab_size)) == NULL)
+            return NULL;
+        s->pool = p;
+        s->free = NULL;
+        s->bump = PADD(s, p->first);
+        s->used = 0;
+        SLAB_PUSH(&p->partial, s, next, prev);
+        SLAB_PUSH(&p->all, s, anext, aprev);
+        p->slabs++;
+        p->empty++;
+    }
+
+    if ((obj = s->free) != NULL)
+        s->free = *(void **)obj;
+    else {
+        obj = s->bump;
+        s->bump += p->obj_size;
+    }
+    if (s->used++ == 0)
+        p->empty--;
+    if (s->used == p->per_slab)
+        SLAB_UNLINK(&p->partial, s, next, prev);
+    p->live++;
+    return obj;
+}
+
+/*
+ * mm_pool_free -- returns obj to pool p, which it must have come from
+ */
+void mm_pool_free(mm_pool_t *p, void *obj) {
+    pool_slab_t *s = (pool_slab_t *)((size_t)obj & ~(p->slab_size - 1));
+
+    *(void **)obj = s->free;
+    s->free = obj;
+    if (s->used-- == p->per_slab)
+        SLAB_PUSH(&p->partial, s, next, prev);
+    p->live--;
+    if (s->used > 0)
+        return;
+
+    /* keep one empty slab to absorb alloc/free churn at the boundary */
+    if (p->empty == 0) {
+        p->empty++;
+        return;
+    }
+    SLAB_UNLINK(&p->partial, s, next, prev);
+    SLAB_UNLINK(&p->all, s, anext, aprev);
+    p->slabs--;
+    release_block(p->h, s);
+}
+
+/*
+ * mm_pool_info -- fills in the occupancy of pool p
+ */
+void mm_pool_info(mm_pool_t *p, mm_poolinfo_t *info) {
+    info->obj_size = p->obj_size;
+    info->slab_size = p->slab_size;
+    info->slabs = p->slabs;
+    info->empty_slabs = p->empty;
+    info->capacity = p->slabs * p->per_slab;
+    info->live = p->live;
+}
+
+/*
+ * mm_pool_destroy -- frees every object of pool p and the pool itself
+ */
+void mm_pool_destroy(mm_pool_t *p) {
+    pool_slab_t *s, *next;
+
+    for (s = p->all; s != NULL; s = next) {
+        next = s->anext;
+        release_block(p->h, s);
+    }
+    release_block(p->h, p);
 }
 
 /* The remaining routines are internal helper routines */
 
+/*
+ * realloc_block -- the resizing work of mm_realloc;
+ * ptr must be allocated and size must be nonzero.
+ */
+static void *realloc_block(mm_heap_t *h, void *ptr, size_t size) {
+    size_t asize;      /* adjusted block size */
+    size_t block_size; /* current block size */
+    size_t avail;      /* bytes available in place (block + free next block) */
+    void *next;
+    void *newp;
+
+    asize = adjust_size(size);
+    block_size = GET_SIZE(HDRP(ptr));
+
+    /* The block is already big enough */
+    if (asize <= block_size) {
+        trim_slack(h, ptr, asize);
+        return ptr;
+    }
+
+    next = NEXT_BLKP(ptr);
+    avail = block_size;
+    if (!GET_ALLOC(HDRP(next)))
+        avail += GET_SIZE(HDRP(next));
+
+    /* Last block in the heap (possibly followed by a free block): grow the heap */
+    if (avail < asize && (GET_SIZE(HDRP(next)) == 0 ||
+                          (!GET_ALLOC(HDRP(next)) && GET_SIZE(HDRP(NEXT_BLKP(next))) == 0))) {
+        /* only as much as trim_slack would keep: a free tail left behind
+           would go to the next malloc and pin the block where it is */
+        if (extend_heap(h, (realloc_room(asize) - avail) / WSIZE) == NULL)
+            return NULL;
+        next = NEXT_BLKP(ptr); /* the new space coalesced into a free block after ptr */
+        avail = block_size + GET_SIZE(HDRP(next));
+    }
+
+    /* Absorb the free next block */
+    if (avail >= asize) {
+        remove_efl(h, next);
+        PUT(HDRP(ptr), PACK(avail, 1));
+        PUT(FTRP(ptr), PACK(avail, 1));
+        trim_slack(h, ptr, asize);
+        return ptr;
+    }
+
+    /* No room in place: move the payload to a fresh block */
+    if ((newp = find_fit(h, asize)) == NULL &&
+        (newp = extend_heap(h, max(asize, CHUNKSIZE) / WSIZE)) == NULL)
+        return NULL;
+    remove_efl(h, newp);
+    PUT(HDRP(newp), PACK(GET_SIZE(HDRP(newp)), 1));
+    PUT(FTRP(newp), PACK(GET_SIZE(HDRP(newp)), 1));
+    trim_slack(h, newp, asize);
+    memcpy(newp, ptr, min(size, block_size - OVERHEAD));
+    heap_free(h, ptr);
+
+    return newp;
+}
+
+/*
+ * sample_block -- Records the freshly allocated block bp of size bytes
+ *                 in h with the heap profiler and draws the next interval.
+ *                 Kept out of line so the callers' fast paths stay small.
+ *                 Blocks of shared heaps are not sampled: another process
+ *                 may free them, and its profiler has no record to drop.
+ */
+static void __attribute__((noinline)) sample_block(mm_heap_t *h, void *bp,
+                                                   size_t size) {
+    size_t rate = __atomic_load_n(&sample_rate, __ATOMIC_RELAXED);
+
+    if (rate != sample_drawn) {
+        /* the rate changed since this thread last drew: start afresh */
+        sample_drawn = rate;
+        sample_left = rate ? (long)heapprof_next_interval(rate) : SAMPLE_RECHECK;
+        return;
+    }
+    if (rate == 0) {
+        sample_left = SAMPLE_RECHECK;
+        return;
+    }
+    if (h->shared) {
+        sample_left = heapprof_next_interval(rate);
+        return;
+    }
+    PUT(HDRP(bp), GET(HDRP(bp)) | SAMPLED);
+    PUT(FTRP(bp), GET(FTRP(bp)) | SAMPLED);
+    /* drop this frame and mm_malloc's/mm_realloc's from the stack */
+    heapprof_record(bp, size, rate, 2);
+    sample_left = heapprof_next_interval(rate);
+}
 
 /*
  * place -- Place block of asize bytes at start of free block bp
@@ -238,17 +1343,15 @@ void mm_free(void *bp) {
  *          If a block was split, add the unallocated part to EFL.
  * bp must be free and in EFL;
  */
-static void place(void *bp, size_t asize) {
+static void place(mm_heap_t *h, void *bp, size_t asize) {
+    MM_PROF_SCOPE(MM_PH_PLACE);
 
-	remove_efl(bp);
+	remove_efl(h, bp);
     size_t block_size = GET_SIZE(HDRP(bp));
 
 	if (block_size >= asize+OVERHEAD+DSIZE){
-		PUT(HDRP(bp), PACK(asize, 1));
-		PUT(FTRP(bp), PACK(asize, 1));
-		PUT(HDRP(NEXT_BLKP(bp)), PACK(block_size - asize, 0));
-		PUT(FTRP(NEXT_BLKP(bp)), PACK(block_size - asize, 0));
-    add_efl(NEXT_BLKP(bp));
+		split_block(bp, block_size, asize, 1, 0);
+    add_efl(h, NEXT_BLKP(bp));
 		return;
 	}
 
@@ -259,13 +1362,74 @@ static void place(void *bp, size_t asize) {
 
 }
 
+/*
+ * split_block -- Splits the block bp of size bytes into one of asize
+ *                bytes and the rest, with allocated bits alloc1 and alloc2.
+ *                bp's header is written last: a process killed half way
+ *                (see mm_share) leaves either the old block or both new
+ *                ones behind it, with at worst a stale footer, which
+ *                heap_recover repairs.
+ */
+static inline void split_block(void *bp, size_t size, size_t asize,
+                               size_t alloc1, size_t alloc2) {
+    PUT(PADD(bp, asize - WSIZE), PACK(size - asize, alloc2)); /* rest's header */
+    PUT(PADD(bp, size - DSIZE), PACK(size - asize, alloc2));  /* rest's footer */
+    PUT(PADD(bp, asize - DSIZE), PACK(asize, alloc1));        /* bp's footer */
+    PUT(HDRP(bp), PACK(asize, alloc1));
+}
+
+/*
+ * shrink_block -- Trim allocated block bp down to asize bytes.
+ *                 The tail is freed (and coalesced) if it is big enough
+ *                 to be a block of its own.
+ * bp must be allocated and at least asize bytes long;
+ */
+static void shrink_block(mm_heap_t *h, void *bp, size_t asize) {
+    MM_PROF_SCOPE(MM_PH_PLACE);
+    size_t block_size = GET_SIZE(HDRP(bp));
+
+    if (block_size >= asize + OVERHEAD + DSIZE) {
+        split_block(bp, block_size, asize, 1, 0);
+        coalesce(h, NEXT_BLKP(bp));
+    }
+}
+
+/*
+ * realloc_room -- Size of a block that realloc resizes to asize bytes:
+ *                 a reallocated block is likely to grow again, so it
+ *                 keeps asize / REALLOC_SLACK bytes (at most a chunk)
+ *                 of room for that.
+ */
+static size_t realloc_room(size_t asize) {
+    return asize + (min(asize / REALLOC_SLACK, CHUNKSIZE) & ~(size_t)(DSIZE - 1));
+}
+
+/*
+ * trim_slack -- Trim a block that realloc resized to asize bytes down
+ *               to realloc_room(asize), splitting the rest off and
+ *               freeing it like place() does. On huge page heaps the
+ *               last block keeps up to a huge page instead, as
+ *               extend_heap grew the heap that far anyway.
+ * bp must be allocated and at least asize bytes long;
+ */
+static void trim_slack(mm_heap_t *h, void *bp, size_t asize) {
+    size_t keep = realloc_room(asize);
+
+    if (mem_hugepage_r(h->mem) && GET_SIZE(HDRP(NEXT_BLKP(bp))) == 0 &&
+        GET_SIZE(HDRP(bp)) - asize < mem_hugepage_r(h->mem))
+        return;
+    if (GET_SIZE(HDRP(bp)) > keep)
+        shrink_block(h, bp, keep);
+}
+
 /*
  * coalesce -- Boundary tag coalescing.
  * Takes a pointer to a free block
  * Return ptr to coalesced block
  * bp has to be free
  */
-static void *coalesce(void *bp) {
+static void *coalesce(mm_heap_t *h, void *bp) {
+    MM_PROF_SCOPE(MM_PH_COALESCE);
 
     void *next = NEXT_BLKP(bp);
     void *prev = PREV_BLKP(bp);
@@ -273,34 +1437,34 @@ static void *coalesce(void *bp) {
     size_t next_alloc = GET_ALLOC(HDRP(next));
 
     if (prev_alloc && next_alloc) {
-        add_efl(bp);
+        add_efl(h, bp);
         return bp;
     }
 
     if (prev_alloc && !next_alloc){
-        remove_efl(next);
+        remove_efl(h, next);
         size_t size = GET_SIZE(HDRP(bp)) + GET_SIZE(HDRP(next));
         PUT(FTRP(next), PACK(size, 0));
         PUT(HDRP(bp), PACK(size, 0));
     }
 
     else if (!prev_alloc && next_alloc){
-        remove_efl(prev);
+        remove_efl(h, prev);
         size_t size = GET_SIZE(HDRP(prev)) + GET_SIZE(HDRP(bp));
         PUT(FTRP(bp), PACK(size, 0));
         PUT(HDRP(prev), PACK(size, 0));
         bp = prev;
     }
     else{
-        remove_efl(prev);
-        remove_efl(next);
+        remove_efl(h, prev);
+        remove_efl(h, next);
         size_t size = GET_SIZE(HDRP(bp)) + GET_SIZE(HDRP(prev)) + GET_SIZE(FTRP(next));
         PUT(HDRP(prev), PACK(size, 0));
         PUT(FTRP(next), PACK(size, 0));
         bp = PREV_BLKP(bp);
     }
 
-    add_efl(bp);
+    add_efl(h, bp);
 	return bp;
 
 }
@@ -311,14 +1475,16 @@ static void *coalesce(void *bp) {
  * return a pointer to a block of a correct size.
  * if can't find such block, return NULL
  */
-static void *find_fit(size_t asize) {
+static void *find_fit(mm_heap_t *h, size_t asize) {
+    MM_PROF_SCOPE(MM_PH_FIND_FIT);
     /* search from the start of the free list to the end */
 
-    if (head_free == NULL){
+    if (h->head_free == NULL){
         return NULL;
     }
-    for (char *cur_block = head_free; cur_block != NULL; cur_block = GET_NEXT_FREE(cur_block)) {
+    for (char *cur_block = h->head_free; cur_block != NULL; cur_block = GET_NEXT_FREE(cur_block)) {
         assert(GET_ALLOC(HDRP(cur_block)) == 0 );
+        MM_TRACE_SEARCH();
         if (asize <= GET_SIZE(HDRP(cur_block))){
             return cur_block;
         }
@@ -331,26 +1497,37 @@ static void *find_fit(size_t asize) {
  * extend_heap - Extend heap with free block and return its block pointer
  *               coalesce the added block with previous block if possible
  */
-static void *extend_heap(size_t words) {
+static void *extend_heap(mm_heap_t *h, size_t words) {
+    MM_PROF_SCOPE(MM_PH_EXTEND);
+    MM_TRACE_START(t);
     // create the block and then add to explicit free list
     char *bp;
-    size_t size;
+    size_t size, huge;
+    uintptr_t brk;
 
     /* Allocate an even number of words to maintain alignment */
     size = words * WSIZE;
     if (words % 2 == 1)
         size += WSIZE;
 
-    if ((long)(bp = mem_sbrk(size)) < 0)
+    /* On huge pages, grow to the next huge page boundary: a huge page
+       the heap only partly covers would be backed all the same */
+    if ((huge = mem_hugepage_r(h->mem)) != 0) {
+        brk = (uintptr_t)mem_heap_hi_r(h->mem) + 1;
+        size = ((brk + size + huge - 1) & ~(uintptr_t)(huge - 1)) - brk;
+    }
+
+    if ((long)(bp = mem_sbrk_r(h->mem, size)) < 0)
         return NULL;
 
     /* Initialize free block header/footer and the epilogue header */
     PUT(HDRP(bp), PACK(size, 0));         /* free block header */
     PUT(FTRP(bp), PACK(size, 0));         /* free block footer */
     PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* new epilogue header */
+    MM_TRACE_EVENT(MMTRACE_EXTEND, t, bp, size);
 
     /* Coalesce if the previous block was free */
-    return coalesce(bp);
+    return coalesce(h, bp);
 }
 
 /*
@@ -359,15 +1536,15 @@ static void *extend_heap(size_t words) {
  * Checks include proper prologue and epilogue, alignment, free list consistency, and matching header and footer
  * Takes a line number (to give the output an identifying tag).
  */
-static bool check_heap(int line) {
+static bool check_heap(mm_heap_t *h, int line) {
     char *bp;
 
-    if ((GET_SIZE(HDRP(heap_start)) != DSIZE) || !GET_ALLOC(HDRP(heap_start))) {
+    if ((GET_SIZE(HDRP(h->heap_start)) != DSIZE) || !GET_ALLOC(HDRP(h->heap_start))) {
         printf("(check_heap at line %d) Error: bad prologue header\n\n", line);
         return false;
     }
 
-    for (bp = heap_start; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+    for (bp = h->heap_start; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
         if (!check_block(line, bp)) {
             return false;
         }
@@ -377,8 +1554,8 @@ static bool check_heap(int line) {
         printf("(check_heap at line %d) Error: bad epilogue header\n\n", line);
         return false;
     }
-    if (head_free != NULL){
-    	for (bp = head_free; bp != NULL; bp = GET_NEXT_FREE(bp)){
+    if (h->head_free != NULL){
+    	for (bp = h->head_free; bp != NULL; bp = GET_NEXT_FREE(bp)){
 	    	if (GET_ALLOC(HDRP(bp))){
 		    	printf("(check heap at line %d) Error: allocated block in explicit free list\n\n", line);
 		    	return false;
@@ -416,12 +1593,12 @@ static bool check_block(int line, void *bp) {
 /*
  * print_heap -- Prints out the current state of the heap
  */
-static void print_heap() {
+static void print_heap(mm_heap_t *h) {
     char *bp;
 
-    printf("Heap (%p):\n", heap_start);
+    printf("Heap (%p):\n", h->heap_start);
 
-    for (bp = heap_start; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+    for (bp = h->heap_start; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
         print_block(bp);
     }
 
@@ -430,8 +1607,8 @@ static void print_heap() {
  /*
   * print_efl - prints out the currect state of the explicit free list;
   */
-static void print_efl() {
-	void *bp = head_free;
+static void print_efl(mm_heap_t *h) {
+	void *bp = h->head_free;
 	while (bp != NULL){
 		print_block(bp);
 		bp = GET_NEXT_FREE(bp);
@@ -460,9 +1637,28 @@ static void print_block(void *bp) {
        fsize, (falloc ? 'a' : 'f'));
 }
 
+/*
+ * adjust_size - returns the block size needed for a payload of size bytes,
+ * including overhead and alignment.
+ */
+static size_t adjust_size(size_t size) {
+    if (size <= DSIZE)
+        return DSIZE + OVERHEAD;
+
+    /* Add overhead and then round up to nearest multiple of double-word alignment */
+    return DSIZE * ((size + (OVERHEAD) + (DSIZE - 1)) / DSIZE);
+}
+
 /*
  * max: returns x if x > y, and y otherwise.
  */
 static size_t max(size_t x, size_t y) {
     return (x > y) ? x : y;
 }
+
+/*
+ * min: returns x if x < y, and y otherwise.
+ */
+static size_t min(size_t x, size_t y) {
+    return (x < y) ? x : y;
+}
@@ -4,6 +4,141 @@ extern int mm_init (void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
+extern void *mm_memalign(size_t align, size_t size);
+extern size_t mm_usable_size(void *ptr);
+
+/* Snapshot of the heap's block structure, filled in by mm_heapinfo */
+typedef struct {
+    size_t alloc_blocks;  /* number of allocated blocks */
+    size_t alloc_bytes;   /* their total size, including headers/footers */
+    size_t free_blocks;   /* number of free blocks */
+    size_t free_bytes;    /* their total size */
+    size_t largest_free;  /* size of the largest free block */
+} mm_heapinfo_t;
+
+extern void mm_heapinfo(mm_heapinfo_t *info);
+
+/*
+ * Independent heaps. Each mm_create'd heap grows in its own region of
+ * up to max_heap bytes (MAX_HEAP if 0) and shares no state with the
+ * others or with the default heap behind mm_malloc and friends, so
+ * subsystems can keep their blocks apart and drop them all at once with
+ * mm_reset or mm_destroy. A heap is not thread-safe; use one per thread
+ * or lock around it.
+ */
+typedef struct mm_heap mm_heap_t;
+
+extern mm_heap_t *mm_create(size_t max_heap);
+extern void mm_destroy(mm_heap_t *heap);
+extern int mm_reset(mm_heap_t *heap);
+extern void *mm_malloc_r(mm_heap_t *heap, size_t size);
+extern void mm_free_r(mm_heap_t *heap, void *ptr);
+extern void *mm_realloc_r(mm_heap_t *heap, void *ptr, size_t size);
+extern void *mm_memalign_r(mm_heap_t *heap, size_t align, size_t size);
+extern void mm_heapinfo_r(mm_heap_t *heap, mm_heapinfo_t *info);
+
+/*
+ * Persistent heaps. mm_open maps a heap from a file, creating it if the
+ * file is empty, and a later mm_open (in this or another process)
+ * resumes it as it was, at the same or another address. mm_close writes
+ * it back; a heap that was not closed is checked and its free list
+ * rebuilt when it is next opened. One process may have a file open at
+ * a time. Data in the heap should be reached from the root object and
+ * link to each other by offsets, not pointers, unless the heap is always
+ * mapped at the same base.
+ */
+extern mm_heap_t *mm_open(const char *path, size_t max_heap, void *base);
+extern int mm_sync(mm_heap_t *heap);
+extern int mm_close(mm_heap_t *heap);
+extern void *mm_root(mm_heap_t *heap);
+extern void mm_set_root(mm_heap_t *heap, void *p);
+
+/*
+ * Shared heaps. mm_share makes or joins a heap in a POSIX shared memory
+ * object (or an unnamed memfd, shared with forked children), mapped at
+ * the same address in every process. The mm_*_r calls on it take a
+ * robust process-shared lock, so one process can allocate a message,
+ * publish its offset (e.g. through mm_root) and another free it without
+ * copying. Arenas and pools are private to a process and must not be
+ * built on a shared heap, and the heap profiler does not sample it.
+ */
+extern mm_heap_t *mm_share(const char *name, size_t max_heap);
+extern void mm_detach(mm_heap_t *heap);
+
+/*
+ * Arenas: bump allocation from large chunks of a heap (the default heap
+ * if NULL). Objects cannot be freed individually; mm_arena_reset frees
+ * all of them at once and mm_arena_destroy also frees the arena.
+ */
+typedef struct mm_arena mm_arena_t;
+
+extern mm_arena_t *mm_arena_create(mm_heap_t *heap, size_t chunk_size);
+extern void *mm_arena_alloc(mm_arena_t *arena, size_t size);
+extern void mm_arena_reset(mm_arena_t *arena);
+extern void mm_arena_destroy(mm_arena_t *arena);
+
+/*
+ * Object pools: fixed-size objects from slabs of a heap. Objects must be
+ * returned to the pool they came from with mm_pool_free.
+ */
+typedef struct mm_pool mm_pool_t;
+
+/* Occupancy of a pool, filled in by mm_pool_info */
+typedef struct {
+    size_t obj_size;     /* object size after rounding for alignment */
+    size_t slab_size;    /* bytes per slab */
+    size_t slabs;        /* slabs held */
+    size_t empty_slabs;  /* slabs without live objects */
+    size_t capacity;     /* objects the slabs can hold */
+    size_t live;         /* objects handed out */
+} mm_poolinfo_t;
+
+extern mm_pool_t *mm_pool_create(size_t obj_size, size_t align);
+extern mm_pool_t *mm_pool_create_r(mm_heap_t *heap, size_t obj_size,
+                                   size_t align);
+extern void *mm_pool_alloc(mm_pool_t *pool);
+extern void mm_pool_free(mm_pool_t *pool, void *obj);
+extern void mm_pool_info(mm_pool_t *pool, mm_poolinfo_t *info);
+extern void mm_pool_destroy(mm_pool_t *pool);
+
+/*
+ * Per-phase cycle attribution, compiled in only with -DMM_PROFILE
+ * (make mdriver.prof). Cycles are exclusive: time spent in a nested
+ * phase (e.g. remove_efl called from place) is charged to that phase
+ * only. MM_PH_API is whatever the public entry points do themselves.
+ */
+enum {
+    MM_PH_FIND_FIT,  /* find_fit */
+    MM_PH_PLACE,     /* place, shrink_block */
+    MM_PH_COALESCE,  /* coalesce */
+    MM_PH_EFL,       /* add_efl, remove_efl */
+    MM_PH_EXTEND,    /* extend_heap */
+    MM_PH_API,       /* mm_init, mm_malloc, mm_free, mm_realloc */
+    MM_PH_NUM
+};
+
+typedef struct {
+    unsigned long long cycles[MM_PH_NUM]; /* exclusive cycles per phase */
+    unsigned long long calls[MM_PH_NUM];  /* entries into each phase */
+} mm_profile_t;
+
+/*
+ * Sampling heap profiler: with a nonzero rate, on average one block per
+ * rate bytes allocated is recorded with its allocation call stack until
+ * it is freed. The profile of the live heap can be dumped at any time.
+ * Threads sample independently, on whichever heaps they allocate from;
+ * a thread notices a change of rate within about a megabyte of
+ * allocation.
+ */
+extern void mm_sample_set_rate(size_t rate);
+extern void mm_sample_summary(size_t *samples, double *est_bytes);
+extern int mm_sample_dump(FILE *fp);
+
+#ifdef MM_PROFILE
+extern const char *mm_phase_names[MM_PH_NUM];
+extern void mm_profile_reset(void);
+extern void mm_profile_get(mm_profile_t *prof);
+#endif
 
 
 /* 
@@ -0,0 +1,130 @@
+/*
+ * mm.hpp - C++ adapters over the mm allocator
+ *
+ *   mm::resource      a std::pmr::memory_resource over one mm heap
+ *   mm::allocator<T>  a standard allocator over the default heap
+ *
+ * Both use the size that C++ hands back on deallocation: requests up to
+ * MAX_POOLED bytes with ordinary alignment are served by one mm_pool per
+ * 16-byte size class, and the size picks the pool again on the way
+ * back, so small objects never touch find_fit or coalesce. Larger
+ * requests go to mm_malloc_r/mm_free_r, and over-aligned ones to
+ * mm_memalign_r. Like the heaps themselves, none of this is
+ * thread-safe.
+ *
+ * The default heap must be set up (mem_init, mm_init) before
+ * mm::allocator or mm::default_resource() is first used.
+ */
+#ifndef __MM_HPP_
+#define __MM_HPP_
+
+#include <cstddef>
+#include <new>
+#include <memory_resource>
+
+extern "C" {
+#include "mm.h"
+}
+
+namespace mm {
+
+class resource : public std::pmr::memory_resource {
+public:
+    static constexpr std::size_t GRAIN = 16;       /* size class width */
+    static constexpr std::size_t MAX_POOLED = 256; /* largest pooled size */
+
+    /* A resource over heap (the default heap if null) */
+    explicit resource(mm_heap_t *heap = nullptr) : heap_(heap), pools_() {}
+
+    ~resource() override {
+        for (mm_pool_t *p : pools_)
+            if (p != nullptr)
+                mm_pool_destroy(p);
+    }
+
+    resource(const resource &) = delete;
+    resource &operator=(const resource &) = delete;
+
+    mm_heap_t *heap() const { return heap_; }
+
+private:
+    void *do_allocate(std::size_t bytes, std::size_t align) override {
+        void *p;
+
+        if (bytes == 0)
+            bytes = 1;
+        if (bytes <= MAX_POOLED && align <= GRAIN)
+            p = mm_pool_alloc(pool(bytes));
+        else if (align <= GRAIN)
+            p = heap_ ? mm_malloc_r(heap_, bytes) : mm_malloc(bytes);
+        else
+            p = heap_ ? mm_memalign_r(heap_, align, bytes)
+                      : mm_memalign(align, bytes);
+        if (p == nullptr)
+            throw std::bad_alloc();
+        return p;
+    }
+
+    void do_deallocate(void *p, std::size_t bytes, std::size_t align) override {
+        if (bytes == 0)
+            bytes = 1;
+        if (bytes <= MAX_POOLED && align <= GRAIN)
+            mm_pool_free(pools_[(bytes - 1) / GRAIN], p);
+        else if (heap_)
+            mm_free_r(heap_, p);
+        else
+            mm_free(p);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+
+    /* The pool of bytes' size class, made on first use */
+    mm_pool_t *pool(std::size_t bytes) {
+        std::size_t c = (bytes - 1) / GRAIN;
+
+        if (pools_[c] == nullptr &&
+            (pools_[c] = mm_pool_create_r(heap_, (c + 1) * GRAIN, GRAIN)) == nullptr)
+            throw std::bad_alloc();
+        return pools_[c];
+    }
+
+    mm_heap_t *heap_;
+    mm_pool_t *pools_[MAX_POOLED / GRAIN];
+};
+
+/* The resource over the default heap that mm::allocator uses */
+inline resource &default_resource() {
+    static resource r;
+    return r;
+}
+
+template <class T>
+class allocator {
+public:
+    using value_type = T;
+
+    allocator() noexcept = default;
+    template <class U>
+    allocator(const allocator<U> &) noexcept {}
+
+    T *allocate(std::size_t n) {
+        if (n > std::size_t(-1) / sizeof(T))
+            throw std::bad_array_new_length();
+        return static_cast<T *>(default_resource().allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *p, std::size_t n) noexcept {
+        default_resource().deallocate(p, n * sizeof(T), alignof(T));
+    }
+};
+
+template <class T, class U>
+bool operator==(const allocator<T> &, const allocator<U> &) noexcept { return true; }
+template <class T, class U>
+bool operator!=(const allocator<T> &, const allocator<U> &) noexcept { return false; }
+
+} /* namespace mm */
+
+#endif /* __MM_HPP_ */
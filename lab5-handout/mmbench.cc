@@ -0,0 +1,211 @@
+/*
+ * mmbench.cc - STL container workloads over mm versus the default allocator
+ *
+ * Runs each workload with std::allocator (libc malloc), mm::allocator
+ * (the default mm heap) and a std::pmr container over an mm::resource
+ * on a heap of its own, and prints the best time per operation.
+ *
+ *   vector     push_back n ints into a fresh vector (growth by copying)
+ *   map        insert n random keys, look each up, erase them all
+ *   umap       the same with std::unordered_map
+ *   churn      a map held at n/8 entries while n keys come and go
+ *   strings    a vector of n short std::strings, built then dropped
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <unistd.h>
+
+#include "mm.hpp"
+
+extern "C" {
+#include "memlib.h"
+}
+
+#define BENCH_HEAP (1UL << 32) /* reservation for each mm heap */
+
+static long n = 100000;  /* operations per workload (-n) */
+static int reps = 5;     /* runs per measurement, the best is kept (-r) */
+static std::vector<int> keys;
+
+/* Time one run of f and return the best of reps runs in seconds */
+static double best_of(const std::function<void()> &f)
+{
+    double best = 1e30;
+
+    for (int r = 0; r < reps; r++) {
+        auto t0 = std::chrono::steady_clock::now();
+        f();
+        auto t1 = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(t1 - t0).count());
+    }
+    return best;
+}
+
+/*
+ * The workloads. A is a prototype allocator; each container rebinds it.
+ * Every workload returns its number of operations.
+ */
+template <class A, class T>
+using rebind = typename std::allocator_traits<A>::template rebind_alloc<T>;
+
+template <class A>
+static long vector_work(A a)
+{
+    std::vector<int, rebind<A, int>> v(a);
+    for (long i = 0; i < n; i++)
+        v.push_back(i);
+    return n;
+}
+
+template <class A>
+static long map_work(A a)
+{
+    std::map<int, int, std::less<int>, rebind<A, std::pair<const int, int>>> m(a);
+    long hits = 0;
+
+    for (long i = 0; i < n; i++)
+        m.emplace(keys[i], i);
+    for (long i = 0; i < n; i++)
+        hits += m.count(keys[i]);
+    for (long i = 0; i < n; i++)
+        m.erase(keys[i]);
+    return 3 * n + (hits < 0);
+}
+
+template <class A>
+static long umap_work(A a)
+{
+    std::unordered_map<int, int, std::hash<int>, std::equal_to<int>,
+                       rebind<A, std::pair<const int, int>>> m(16, std::hash<int>(),
+                                                              std::equal_to<int>(), a);
+    long hits = 0;
+
+    for (long i = 0; i < n; i++)
+        m.emplace(keys[i], i);
+    for (long i = 0; i < n; i++)
+        hits += m.count(keys[i]);
+    for (long i = 0; i < n; i++)
+        m.erase(keys[i]);
+    return 3 * n + (hits < 0);
+}
+
+template <class A>
+static long churn_work(A a)
+{
+    std::map<int, int, std::less<int>, rebind<A, std::pair<const int, int>>> m(a);
+    long window = n / 8 + 1;
+
+    for (long i = 0; i < n; i++) {
+        m.emplace(keys[i], i);
+        if (i >= window)
+            m.erase(keys[i - window]);
+    }
+    return 2 * n;
+}
+
+template <class A>
+static long strings_work(A a)
+{
+    using str = std::basic_string<char, std::char_traits<char>, rebind<A, char>>;
+    std::vector<str, rebind<A, str>> v(a);
+
+    v.reserve(n);
+    for (long i = 0; i < n; i++) {
+        /* longer than the small-string buffer, so each one allocates */
+        str s("key-0123456789abcdef-", a);
+        s += std::to_string(keys[i]).c_str();
+        v.push_back(std::move(s));
+    }
+    return n;
+}
+
+/* Time one workload under all three allocators and print a row */
+static void row(const char *name, double ops,
+                const std::function<long()> &std_run,
+                const std::function<long()> &mm_run,
+                const std::function<long()> &pmr_run)
+{
+    double s = best_of([&] { std_run(); });
+    double m = best_of([&] { mm_run(); });
+    double p = best_of([&] { pmr_run(); });
+
+    printf("%-9s %10.0f %10.1f %10.1f %10.1f %8.2fx %8.2fx\n", name, ops,
+           s / ops * 1e9, m / ops * 1e9, p / ops * 1e9, s / m, s / p);
+}
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv)
+{
+    int c;
+
+    while ((c = getopt(argc, argv, "n:r:h")) != EOF) {
+        switch (c) {
+        case 'n': /* Operations per workload */
+            n = atol(optarg);
+            break;
+        case 'r': /* Runs per measurement */
+            reps = atoi(optarg);
+            break;
+        case 'h': /* Print this message */
+        default:
+            fprintf(stderr, "Usage: mmbench [-h] [-n <ops>] [-r <runs>]\n");
+            fprintf(stderr, "Options\n");
+            fprintf(stderr, "\t-n <ops>   Operations per workload (default 100000).\n");
+            fprintf(stderr, "\t-r <runs>  Runs per measurement, best is kept (default 5).\n");
+            fprintf(stderr, "\t-h         Print this message.\n");
+            exit(c == 'h' ? 0 : 1);
+        }
+    }
+    if (n < 1 || reps < 1) {
+        fprintf(stderr, "mmbench: -n and -r must be positive\n");
+        exit(1);
+    }
+
+    std::mt19937 rng(208);
+    keys.resize(n);
+    for (long i = 0; i < n; i++)
+        keys[i] = rng();
+
+    mem_init(BENCH_HEAP);
+    if (mm_init() < 0) {
+        fprintf(stderr, "mmbench: mm_init failed\n");
+        exit(1);
+    }
+    mm_heap_t *heap = mm_create(BENCH_HEAP);
+    if (heap == NULL) {
+        fprintf(stderr, "mmbench: mm_create failed\n");
+        exit(1);
+    }
+
+    {
+        mm::resource res(heap);
+        std::allocator<char> sa;
+        mm::allocator<char> ma;
+        std::pmr::polymorphic_allocator<char> pa(&res);
+
+        printf("%-9s %10s %10s %10s %10s %9s %9s\n", "workload", "ops",
+               "std ns/op", "mm ns/op", "pmr ns/op", "std/mm", "std/pmr");
+#define ROW(name, work) \
+        row(name, work(sa), [&] { return work(sa); }, [&] { return work(ma); }, \
+            [&] { return work(pa); })
+        ROW("vector", vector_work);
+        ROW("map", map_work);
+        ROW("umap", umap_work);
+        ROW("churn", churn_work);
+        ROW("strings", strings_work);
+#undef ROW
+    }
+
+    mm_destroy(heap);
+    return 0;
+}
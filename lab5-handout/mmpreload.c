@@ -0,0 +1,246 @@
+/*
+ * mmpreload.c - Run unmodified programs on the mm allocator
+ *
+ * Built together with mm.c, memlib.c and heapprof.c as libmm.so, this
+ * replaces the whole malloc family of libc:
+ *
+ *   unix> LD_PRELOAD=./libmm.so ls -l
+ *
+ * Every call takes one global mutex around the default mm heap, so the
+ * library is thread-safe (though not scalable). The mutex is taken
+ * before fork and released in both processes afterwards, so the child
+ * never inherits a heap in the middle of an update. The heap is a
+ * MAP_NORESERVE reservation from mem_init; only the pages the program
+ * actually touches are backed.
+ *
+ * Environment:
+ *   MM_HEAP_SIZE   size of the reservation, with an optional K, M or G
+ *                  suffix (default 64G)
+ *   MM_BACKEND     how the reservation is backed, e.g. lazy (the
+ *                  default), commit,prefault or commit,huge (see
+ *                  mem_set_backend)
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define DEFAULT_HEAP (64ULL << 30) /* reservation if MM_HEAP_SIZE is unset */
+
+#define EXPORT __attribute__((visibility("default")))
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int ready = 0;   /* heap set up? */
+
+/*
+ * heap_size - the reservation size from MM_HEAP_SIZE; parsed by hand
+ *    because this runs inside the first malloc
+ */
+static size_t heap_size(void)
+{
+    char *s = getenv("MM_HEAP_SIZE");
+    size_t n = 0;
+
+    if (s == NULL || *s < '0' || *s > '9')
+        return DEFAULT_HEAP;
+    for (; *s >= '0' && *s <= '9'; s++)
+        n = n * 10 + (*s - '0');
+    switch (*s) {
+    case 'g': case 'G': n <<= 10; /* fall through */
+    case 'm': case 'M': n <<= 10; /* fall through */
+    case 'k': case 'K': n <<= 10;
+    }
+    return n ? n : DEFAULT_HEAP;
+}
+
+/*
+ * enter - take the lock, setting up the heap on first use
+ */
+static void enter(void)
+{
+    char *backend;
+
+    pthread_mutex_lock(&lock);
+    if (!ready) {
+        backend = getenv("MM_BACKEND");
+        if (backend != NULL && mem_set_backend(backend) < 0)
+            fprintf(stderr, "libmm: unknown MM_BACKEND %s\n", backend);
+        mem_init(heap_size());
+        if (mm_init() < 0) {
+            fprintf(stderr, "libmm: mm_init failed\n");
+            abort();
+        }
+        ready = 1;
+    }
+}
+
+static void leave(void)
+{
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Fork handlers: hold the lock across fork so that the child's copy of
+ * the heap is consistent, then release it on both sides
+ */
+static void fork_prepare(void)
+{
+    pthread_mutex_lock(&lock);
+}
+
+static void fork_parent(void)
+{
+    pthread_mutex_unlock(&lock);
+}
+
+static void fork_child(void)
+{
+    pthread_mutex_init(&lock, NULL);
+}
+
+/*
+ * mmpreload_init - register the fork handlers (runs at load time,
+ *    before any lock is held, since pthread_atfork may itself allocate)
+ */
+__attribute__((constructor))
+static void mmpreload_init(void)
+{
+    pthread_atfork(fork_prepare, fork_parent, fork_child);
+}
+
+/*
+ * aligned - allocate size bytes at a multiple of align (a power of two)
+ */
+static void *aligned(size_t align, size_t size)
+{
+    void *p;
+
+    enter();
+    p = mm_memalign(align, size ? size : 1);
+    leave();
+    return p;
+}
+
+/***********************
+ * The malloc interface
+ ***********************/
+
+EXPORT void *malloc(size_t size)
+{
+    void *p;
+
+    enter();
+    p = mm_malloc(size ? size : 1);
+    leave();
+    if (p == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+EXPORT void free(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+    enter();
+    mm_free(ptr);
+    leave();
+}
+
+EXPORT void *realloc(void *ptr, size_t size)
+{
+    void *p;
+
+    if (ptr != NULL && size == 0) {
+        free(ptr);
+        return NULL;
+    }
+    enter();
+    p = mm_realloc(ptr, size ? size : 1);
+    leave();
+    if (p == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+EXPORT void *calloc(size_t nmemb, size_t size)
+{
+    size_t bytes = nmemb * size;
+    void *p;
+
+    if (size != 0 && nmemb > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    /* not malloc + memset, which gcc would turn back into a calloc call */
+    enter();
+    p = mm_malloc(bytes ? bytes : 1);
+    leave();
+    if (p == NULL)
+        errno = ENOMEM;
+    else
+        memset(p, 0, bytes);
+    return p;
+}
+
+EXPORT void *reallocarray(void *ptr, size_t nmemb, size_t size)
+{
+    if (size != 0 && nmemb > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return realloc(ptr, nmemb * size);
+}
+
+EXPORT int posix_memalign(void **memptr, size_t align, size_t size)
+{
+    void *p;
+
+    if (align < sizeof(void *) || (align & (align - 1)) != 0)
+        return EINVAL;
+    if ((p = aligned(align, size)) == NULL)
+        return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+EXPORT void *aligned_alloc(size_t align, size_t size)
+{
+    void *p;
+
+    if ((align & (align - 1)) != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if ((p = aligned(align, size)) == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+EXPORT void *memalign(size_t align, size_t size)
+{
+    return aligned_alloc(align, size);
+}
+
+EXPORT void *valloc(size_t size)
+{
+    return aligned_alloc(getpagesize(), size);
+}
+
+EXPORT void *pvalloc(size_t size)
+{
+    size_t page = getpagesize();
+
+    return aligned_alloc(page, (size + page - 1) & ~(page - 1));
+}
+
+EXPORT size_t malloc_usable_size(void *ptr)
+{
+    return ptr ? mm_usable_size(ptr) : 0;
+}
@@ -0,0 +1,745 @@
+/*
+ * mmrecord.c - Record the allocation stream of an unmodified program
+ *
+ * Built as libmmrecord.so and loaded with LD_PRELOAD, this interposes
+ * malloc, free, realloc, calloc, posix_memalign, aligned_alloc and
+ * memalign, forwards them to the real libc functions and records every
+ * call:
+ *
+ *   unix> LD_PRELOAD=./libmmrecord.so MMRECORD_FILE=ls.rep ls -l
+ *   unix> mdriver -V -f ls.12345.rep
+ *
+ * Every process that loads the library writes its own trace, with its
+ * pid inserted before the extension of MMRECORD_FILE, so the children
+ * of a recorded shell or make do not overwrite each other. Aligned
+ * allocations are recorded as plain allocations of the same size,
+ * since a .rep trace has no way to ask for an alignment; valloc and
+ * pvalloc are not recorded.
+ *
+ * Each thread appends fixed-size binary events to its own buffer. Full
+ * buffers are handed to a writer thread, which appends them to
+ * <trace>.bin with write(2), so the recorded threads never block on
+ * I/O. A global sequence number gives every event its place in the
+ * program-wide order. When the program exits, the binary log is sorted
+ * by sequence number, pointers are mapped to dense block ids, and the
+ * result is written as a .rep trace. Blocks that are still live at exit
+ * are freed at the end of the trace so that it is balanced; frees of
+ * pointers allocated before recording started are dropped.
+ *
+ * Environment:
+ *   MMRECORD_FILE    output trace; the pid is added to the name
+ *                    (default mmrecord.rep, giving mmrecord.<pid>.rep)
+ *   MMRECORD_BINARY  if set, keep only the binary log (<trace>.bin) and
+ *                    skip the conversion; convert it later with
+ *                    "mmrecord-conv <trace>.bin <trace>"
+ *
+ * The same source built with -DMMRECORD_CONVERT is the mmrecord-conv
+ * program.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Misc */
+#define MAXLINE      1024
+#define BUF_EVENTS   4096   /* events per thread buffer */
+#define BOOT_BYTES   8192   /* static arena used while dlsym runs */
+#define REC_MAGIC    0x3243455244524d4dULL /* "MMRDREC2" */
+
+/* Event types */
+enum {EV_ALLOC, EV_FREE, EV_REALLOC, EV_RELEASE};
+
+/* One recorded call; this is also the record layout of the binary log */
+typedef struct {
+    uint64_t seq;     /* program-wide order of the call */
+    uint64_t ptr;     /* block returned (alloc, realloc), freed (free) or
+                         handed to realloc (release) */
+    uint64_t oldptr;  /* realloc only: the block passed in */
+    uint64_t size;    /* requested size in bytes */
+    uint32_t type;    /* EV_ALLOC, EV_FREE, EV_REALLOC or EV_RELEASE */
+    uint32_t tid;     /* recording thread, pairs a release with its realloc */
+} event_t;
+
+/* A per-thread buffer of events */
+typedef struct recbuf {
+    struct recbuf *next;      /* link in the full/free/active lists */
+    struct recbuf *all_next;  /* link in the list of all buffers */
+    int n;                    /* number of events in the buffer */
+    int active;               /* owned by a live thread? */
+    event_t ev[BUF_EVENTS];
+} recbuf_t;
+
+/* Maps pointer values to block ids during conversion */
+typedef struct {
+    uint64_t ptr;
+    long id;
+} idmap_t;
+
+/*********************
+ * Function prototypes
+ *********************/
+static int convert(char *binpath, char *reppath);
+static int event_cmp(const void *a, const void *b);
+
+#ifndef MMRECORD_CONVERT
+
+/********************
+ * Global variables
+ *******************/
+static void *(*real_malloc)(size_t);
+static void (*real_free)(void *);
+static void *(*real_realloc)(void *, size_t);
+static void *(*real_calloc)(size_t, size_t);
+static int (*real_posix_memalign)(void **, size_t, size_t);
+static void *(*real_aligned_alloc)(size_t, size_t);
+static void *(*real_memalign)(size_t, size_t);
+
+static volatile int recording = 0;        /* are calls being recorded? */
+static uint64_t seqno = 0;                /* next sequence number */
+static uint32_t num_threads = 0;          /* threads that have recorded */
+static __thread uint32_t tid = 0;         /* this thread's number, from 1 */
+static __thread int in_recorder = 0;      /* our own calls are not recorded */
+static __thread recbuf_t *tbuf = NULL;    /* this thread's buffer */
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER; /* guards the lists */
+static pthread_cond_t full_cond = PTHREAD_COND_INITIALIZER;
+static recbuf_t *full_head = NULL, *full_tail = NULL; /* waiting for the writer */
+static recbuf_t *free_list = NULL;        /* empty buffers for reuse */
+static recbuf_t *all_bufs = NULL;         /* every buffer ever created */
+static int stopping = 0;                  /* tells the writer to finish */
+static pthread_t writer;
+static pthread_key_t exit_key;            /* flushes a thread's buffer on exit */
+static int out_fd = -1;
+static char reppath[MAXLINE];
+static char binpath[MAXLINE + 8];
+
+static char boot_arena[BOOT_BYTES];       /* for calloc calls made by dlsym */
+static size_t boot_used = 0;
+
+/*
+ * boot_alloc - serve allocations made before the real functions are known
+ */
+static void *boot_alloc(size_t size)
+{
+    void *p;
+
+    size = (size + 15) & ~(size_t)15;
+    if (boot_used + size > BOOT_BYTES)
+        return NULL;
+    p = boot_arena + boot_used;
+    boot_used += size;
+    return p;
+}
+
+/*
+ * resolve - look up the libc functions we forward to
+ */
+static void resolve(void)
+{
+    static __thread int resolving = 0;
+
+    if (resolving)
+        return;
+    resolving = 1;
+    real_malloc = dlsym(RTLD_NEXT, "malloc");
+    real_free = dlsym(RTLD_NEXT, "free");
+    real_realloc = dlsym(RTLD_NEXT, "realloc");
+    real_calloc = dlsym(RTLD_NEXT, "calloc");
+    real_posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+    real_aligned_alloc = dlsym(RTLD_NEXT, "aligned_alloc");
+    real_memalign = dlsym(RTLD_NEXT, "memalign");
+    resolving = 0;
+}
+
+/*
+ * new_buffer - get an empty buffer, from the free list or from mmap
+ */
+static recbuf_t *new_buffer(void)
+{
+    recbuf_t *b;
+
+    pthread_mutex_lock(&lock);
+    if ((b = free_list) != NULL) {
+        free_list = b->next;
+    }
+    else {
+        b = mmap(NULL, sizeof(recbuf_t), PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (b == MAP_FAILED) {
+            pthread_mutex_unlock(&lock);
+            return NULL;
+        }
+        b->all_next = all_bufs;
+        all_bufs = b;
+    }
+    b->next = NULL;
+    b->n = 0;
+    b->active = 1;
+    pthread_mutex_unlock(&lock);
+    return b;
+}
+
+/*
+ * hand_off - queue a buffer for the writer thread
+ */
+static void hand_off(recbuf_t *b)
+{
+    pthread_mutex_lock(&lock);
+    b->active = 0;
+    b->next = NULL;
+    if (full_tail)
+        full_tail->next = b;
+    else
+        full_head = b;
+    full_tail = b;
+    pthread_cond_signal(&full_cond);
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * thread_exit - pthread key destructor: flush the exiting thread's buffer
+ */
+static void thread_exit(void *arg)
+{
+    recbuf_t *b = arg;
+
+    if (b != NULL && b == tbuf) {
+        tbuf = NULL;
+        hand_off(b);
+    }
+}
+
+/*
+ * record - append an event to the calling thread's buffer
+ */
+static void record(uint32_t type, void *ptr, void *oldptr, size_t size)
+{
+    event_t *e;
+
+    if (!recording || in_recorder)
+        return;
+    in_recorder = 1;
+
+    if (tbuf == NULL) {
+        if ((tbuf = new_buffer()) == NULL) {
+            in_recorder = 0;
+            return;
+        }
+        pthread_setspecific(exit_key, tbuf);
+    }
+    if (tid == 0)
+        tid = __atomic_add_fetch(&num_threads, 1, __ATOMIC_RELAXED);
+
+    e = &tbuf->ev[tbuf->n++];
+    e->seq = __atomic_fetch_add(&seqno, 1, __ATOMIC_RELAXED);
+    e->ptr = (uint64_t)(uintptr_t)ptr;
+    e->oldptr = (uint64_t)(uintptr_t)oldptr;
+    e->size = size;
+    e->type = type;
+    e->tid = tid;
+
+    if (tbuf->n == BUF_EVENTS) {
+        hand_off(tbuf);
+        tbuf = new_buffer();
+        pthread_setspecific(exit_key, tbuf);
+    }
+    in_recorder = 0;
+}
+
+/*
+ * writer_main - append full buffers to the binary log until told to stop
+ */
+static void *writer_main(void *arg)
+{
+    recbuf_t *b;
+    size_t len, done;
+    ssize_t rc;
+
+    in_recorder = 1;
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        while (full_head == NULL && !stopping)
+            pthread_cond_wait(&full_cond, &lock);
+        if (full_head == NULL)
+            break;
+        b = full_head;
+        full_head = b->next;
+        if (full_head == NULL)
+            full_tail = NULL;
+        pthread_mutex_unlock(&lock);
+
+        len = b->n * sizeof(event_t);
+        for (done = 0; done < len; done += rc) {
+            rc = write(out_fd, (char *)b->ev + done, len - done);
+            if (rc < 0 && errno == EINTR)
+                rc = 0;
+            else if (rc < 0)
+                break;
+        }
+
+        pthread_mutex_lock(&lock);
+        b->next = free_list;
+        free_list = b;
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+/*
+ * fork_child - threads do not survive fork, so the child stops recording
+ */
+static void fork_child(void)
+{
+    recording = 0;
+    pthread_mutex_init(&lock, NULL);
+}
+
+/*
+ * trace_name - insert the pid before the extension of the trace name
+ */
+static void trace_name(char *buf, size_t len, char *file)
+{
+    char *dot = strrchr(file, '.');
+
+    if (dot == NULL || dot == file || strchr(dot, '/') != NULL || dot[-1] == '/')
+        snprintf(buf, len, "%s.%d", file, (int)getpid());
+    else
+        snprintf(buf, len, "%.*s.%d%s", (int)(dot - file), file, (int)getpid(), dot);
+}
+
+/*
+ * mmrecord_init - open the log and start the writer (runs at load time)
+ */
+__attribute__((constructor))
+static void mmrecord_init(void)
+{
+    char *file = getenv("MMRECORD_FILE");
+    uint64_t magic = REC_MAGIC;
+
+    in_recorder = 1;
+    if (real_malloc == NULL)
+        resolve();
+
+    trace_name(reppath, MAXLINE, file ? file : "mmrecord.rep");
+    snprintf(binpath, sizeof(binpath), "%s.bin", reppath);
+    if ((out_fd = open(binpath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0) {
+        fprintf(stderr, "mmrecord: could not open %s: %s\n", binpath, strerror(errno));
+        in_recorder = 0;
+        return;
+    }
+    if (write(out_fd, &magic, sizeof(magic)) != sizeof(magic)) {
+        close(out_fd);
+        in_recorder = 0;
+        return;
+    }
+
+    pthread_key_create(&exit_key, thread_exit);
+    pthread_atfork(NULL, NULL, fork_child);
+    if (pthread_create(&writer, NULL, writer_main, NULL) != 0) {
+        close(out_fd);
+        in_recorder = 0;
+        return;
+    }
+    recording = 1;
+    in_recorder = 0;
+}
+
+/*
+ * mmrecord_fini - drain every buffer, stop the writer and convert the log
+ */
+__attribute__((destructor))
+static void mmrecord_fini(void)
+{
+    recbuf_t *b;
+
+    if (!recording)
+        return;
+    recording = 0;
+    in_recorder = 1;
+
+    /* Buffers of threads that are still running at exit */
+    pthread_mutex_lock(&lock);
+    for (b = all_bufs; b != NULL; b = b->all_next) {
+        if (b->active && b->n > 0) {
+            b->active = 0;
+            b->next = NULL;
+            if (full_tail)
+                full_tail->next = b;
+            else
+                full_head = b;
+            full_tail = b;
+        }
+    }
+    tbuf = NULL;
+    stopping = 1;
+    pthread_cond_signal(&full_cond);
+    pthread_mutex_unlock(&lock);
+
+    pthread_join(writer, NULL);
+    close(out_fd);
+
+    if (getenv("MMRECORD_BINARY") == NULL && convert(binpath, reppath) == 0)
+        unlink(binpath);
+}
+
+/*****************************
+ * The interposed entry points
+ ****************************/
+
+void *malloc(size_t size)
+{
+    void *p;
+
+    if (real_malloc == NULL)
+        resolve();
+    if (real_malloc == NULL)
+        return boot_alloc(size);
+    if ((p = real_malloc(size)) != NULL)
+        record(EV_ALLOC, p, NULL, size);
+    return p;
+}
+
+void free(void *ptr)
+{
+    if (ptr == NULL || ((char *)ptr >= boot_arena && (char *)ptr < boot_arena + BOOT_BYTES))
+        return;
+    /* record before the block can be handed out again */
+    record(EV_FREE, ptr, NULL, 0);
+    if (real_free == NULL)
+        resolve();
+    real_free(ptr);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    void *p;
+
+    if (real_realloc == NULL)
+        resolve();
+    if (ptr != NULL && (char *)ptr >= boot_arena && (char *)ptr < boot_arena + BOOT_BYTES) {
+        /* a boot block cannot be resized in place: move it to the real heap */
+        size_t avail = boot_arena + BOOT_BYTES - (char *)ptr;
+        if ((p = malloc(size)) != NULL)
+            memcpy(p, ptr, (size < avail) ? size : avail);
+        return p;
+    }
+    /* record the release of ptr before realloc can hand it to another thread */
+    if (ptr != NULL)
+        record(EV_RELEASE, ptr, NULL, size);
+    p = real_realloc(ptr, size);
+    if (p != NULL || ptr != NULL)
+        record(EV_REALLOC, p, ptr, size);
+    return p;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *p;
+
+    if (real_calloc == NULL)
+        resolve();
+    if (real_calloc == NULL)
+        return boot_alloc(nmemb * size); /* boot arena is zero-initialized */
+    if ((p = real_calloc(nmemb, size)) != NULL)
+        record(EV_ALLOC, p, NULL, nmemb * size);
+    return p;
+}
+
+int posix_memalign(void **memptr, size_t align, size_t size)
+{
+    int rc;
+
+    if (real_posix_memalign == NULL)
+        resolve();
+    if (real_posix_memalign == NULL)
+        return ENOMEM;
+    if ((rc = real_posix_memalign(memptr, align, size)) == 0)
+        record(EV_ALLOC, *memptr, NULL, size);
+    return rc;
+}
+
+void *aligned_alloc(size_t align, size_t size)
+{
+    void *p;
+
+    if (real_aligned_alloc == NULL)
+        resolve();
+    if (real_aligned_alloc == NULL)
+        return NULL;
+    if ((p = real_aligned_alloc(align, size)) != NULL)
+        record(EV_ALLOC, p, NULL, size);
+    return p;
+}
+
+void *memalign(size_t align, size_t size)
+{
+    void *p;
+
+    if (real_memalign == NULL)
+        resolve();
+    if (real_memalign == NULL)
+        return NULL;
+    if ((p = real_memalign(align, size)) != NULL)
+        record(EV_ALLOC, p, NULL, size);
+    return p;
+}
+
+#else /* MMRECORD_CONVERT */
+
+/*
+ * main - convert a binary log written with MMRECORD_BINARY to .rep
+ */
+int main(int argc, char **argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "Usage: mmrecord-conv <log.bin> <trace.rep>\n");
+        exit(1);
+    }
+    exit(convert(argv[1], argv[2]) == 0 ? 0 : 1);
+}
+
+#endif /* MMRECORD_CONVERT */
+
+/****************************************
+ * Conversion of the binary log to .rep
+ ***************************************/
+
+/*
+ * event_cmp - order events by sequence number
+ */
+static int event_cmp(const void *a, const void *b)
+{
+    uint64_t x = ((const event_t *)a)->seq, y = ((const event_t *)b)->seq;
+    return (x > y) - (x < y);
+}
+
+/*
+ * id_slot - find the hash slot of ptr (empty slot if ptr is not mapped)
+ */
+static idmap_t *id_slot(idmap_t *map, size_t mask, uint64_t ptr)
+{
+    size_t i = (size_t)((ptr >> 4) * 0x9E3779B97F4A7C15ULL) & mask;
+
+    while (map[i].ptr != 0 && map[i].ptr != ptr)
+        i = (i + 1) & mask;
+    return &map[i];
+}
+
+/*
+ * id_remove - unmap a pointer, keeping the linear probe chains intact
+ */
+static void id_remove(idmap_t *map, size_t mask, idmap_t *slot)
+{
+    size_t i = (size_t)(slot - map), j = i, k;
+
+    map[i].ptr = 0;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (map[j].ptr == 0)
+            return;
+        k = (size_t)((map[j].ptr >> 4) * 0x9E3779B97F4A7C15ULL) & mask;
+        /* move j back into the hole at i if its home slot is not in (i, j] */
+        if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+            continue;
+        map[i] = map[j];
+        map[j].ptr = 0;
+        i = j;
+    }
+}
+
+/* Emit an op line into the in-memory body, growing it as needed */
+#define EMIT(...) do { \
+    if (body_len + 64 > body_max) { \
+        body_max = body_max ? 2 * body_max : (1 << 20); \
+        if ((body = realloc(body, body_max)) == NULL) \
+            goto out; \
+    } \
+    body_len += sprintf(body + body_len, __VA_ARGS__); \
+    num_ops++; \
+} while (0)
+
+/*
+ * convert - turn a binary log into a balanced .rep trace
+ *    Returns 0 on success, -1 on failure.
+ */
+static int convert(char *binpath, char *reppath)
+{
+    int fd, rc = -1;
+    struct stat st;
+    char *raw = MAP_FAILED;
+    event_t *ev = NULL;
+    size_t n, i, cap, mask;
+    idmap_t *map = NULL, *parked = NULL, *slot;
+    long num_ids = 0, num_ops = 0, id;
+    uint64_t size, live = 0, peak = 0, *sizes = NULL;
+    char *body = NULL;
+    size_t body_len = 0, body_max = 0;
+    FILE *fp;
+
+    if ((fd = open(binpath, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "mmrecord: could not read %s: %s\n", binpath, strerror(errno));
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(uint64_t) ||
+        (raw = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED ||
+        *(uint64_t *)raw != REC_MAGIC) {
+        fprintf(stderr, "mmrecord: %s is not an mmrecord log\n", binpath);
+        goto out;
+    }
+
+    /* Sort a copy of the events into program order */
+    n = (st.st_size - sizeof(uint64_t)) / sizeof(event_t);
+    if ((ev = malloc(n * sizeof(event_t) + 1)) == NULL)
+        goto out;
+    memcpy(ev, raw + sizeof(uint64_t), n * sizeof(event_t));
+    qsort(ev, n, sizeof(event_t), event_cmp);
+
+    /* Pointer -> id map, at most half full, and thread -> id map of the
+       blocks released by a realloc that has not returned yet */
+    for (cap = 1024; cap < 2 * n + 2; cap *= 2)
+        ;
+    mask = cap - 1;
+    if ((map = calloc(cap, sizeof(idmap_t))) == NULL ||
+        (parked = calloc(cap, sizeof(idmap_t))) == NULL ||
+        (sizes = malloc((n + 1) * sizeof(uint64_t))) == NULL)
+        goto out;
+
+    for (i = 0; i < n; i++) {
+        uint64_t ptr = ev[i].ptr;
+        uint64_t oldptr = ev[i].oldptr;
+
+        /* realloc(NULL, n) allocates */
+        if (ev[i].type == EV_REALLOC && oldptr == 0)
+            ev[i].type = EV_ALLOC;
+
+        size = ev[i].size ? ev[i].size : 1; /* mm_malloc(0) is not a valid request */
+
+        switch (ev[i].type) {
+        case EV_ALLOC:
+            slot = id_slot(map, mask, ptr);
+            if (slot->ptr != 0) {
+                /* the free of this block raced with its reuse; free it now */
+                EMIT("f %ld\n", slot->id);
+                live -= sizes[slot->id];
+                id_remove(map, mask, slot);
+                slot = id_slot(map, mask, ptr);
+            }
+            slot->ptr = ptr;
+            slot->id = id = num_ids++;
+            sizes[id] = size;
+            live += size;
+            EMIT("a %ld %llu\n", id, (unsigned long long)size);
+            break;
+
+        case EV_FREE:
+            slot = id_slot(map, mask, ptr);
+            if (slot->ptr == 0) /* allocated before recording started */
+                break;
+            EMIT("f %ld\n", slot->id);
+            live -= sizes[slot->id];
+            id_remove(map, mask, slot);
+            break;
+
+        case EV_RELEASE:
+            /* park the block until its realloc returns, so that another
+               thread can be handed the same address in the meantime */
+            slot = id_slot(map, mask, ptr);
+            if (slot->ptr == 0) /* allocated before recording started */
+                break;
+            id = slot->id;
+            id_remove(map, mask, slot);
+            slot = id_slot(parked, mask, ev[i].tid);
+            slot->ptr = ev[i].tid;
+            slot->id = id;
+            break;
+
+        case EV_REALLOC:
+            slot = id_slot(parked, mask, ev[i].tid);
+            if (slot->ptr == 0) {
+                /* unknown old block: treat as a fresh allocation */
+                if (ptr == 0)
+                    break;
+                slot = id_slot(map, mask, ptr);
+                if (slot->ptr != 0) {
+                    EMIT("f %ld\n", slot->id);
+                    live -= sizes[slot->id];
+                    id_remove(map, mask, slot);
+                    slot = id_slot(map, mask, ptr);
+                }
+                slot->ptr = ptr;
+                slot->id = id = num_ids++;
+                sizes[id] = size;
+                live += size;
+                EMIT("a %ld %llu\n", id, (unsigned long long)size);
+                break;
+            }
+            id = slot->id;
+            id_remove(parked, mask, slot);
+            if (ptr == 0 && ev[i].size == 0) {
+                /* realloc(p, 0) freed p */
+                EMIT("f %ld\n", id);
+                live -= sizes[id];
+                break;
+            }
+            if (ptr == 0) {
+                /* realloc failed and p is still where it was */
+                slot = id_slot(map, mask, oldptr);
+                slot->ptr = oldptr;
+                slot->id = id;
+                break;
+            }
+            slot = id_slot(map, mask, ptr);
+            if (slot->ptr != 0) {
+                EMIT("f %ld\n", slot->id);
+                live -= sizes[slot->id];
+                id_remove(map, mask, slot);
+                slot = id_slot(map, mask, ptr);
+            }
+            slot->ptr = ptr;
+            slot->id = id;
+            live += size - sizes[id];
+            sizes[id] = size;
+            EMIT("r %ld %llu\n", id, (unsigned long long)size);
+            break;
+        }
+        if (live > peak)
+            peak = live;
+    }
+
+    /* Free whatever is still live so the trace is balanced */
+    for (i = 0; i < cap; i++) {
+        if (map[i].ptr != 0)
+            EMIT("f %ld\n", map[i].id);
+        if (parked[i].ptr != 0)
+            EMIT("f %ld\n", parked[i].id);
+    }
+
+    if ((fp = fopen(reppath, "w")) == NULL) {
+        fprintf(stderr, "mmrecord: could not open %s: %s\n", reppath, strerror(errno));
+        goto out;
+    }
+    fprintf(fp, "%llu\n%ld\n%ld\n%d\n", (unsigned long long)peak, num_ids, num_ops, 1);
+    if (body_len > 0)
+        fwrite(body, 1, body_len, fp);
+    rc = fclose(fp) == 0 ? 0 : -1;
+
+out:
+    if (raw != MAP_FAILED)
+        munmap(raw, st.st_size);
+    close(fd);
+    free(ev);
+    free(map);
+    free(parked);
+    free(sizes);
+    free(body);
+    return rc;
+}
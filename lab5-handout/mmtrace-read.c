@@ -0,0 +1,291 @@
+/*
+ * mmtrace-read.c - Render a binary event trace written by mmtrace.c
+ *
+ * Reads every drain in the file, merges the events of all threads by
+ * time and prints:
+ *
+ *   - per event type: count, latency percentiles and free-list search
+ *     lengths
+ *   - the K slowest events, each with the events that the same thread
+ *     recorded just before and after it
+ *   - with -t, the whole timeline (or the part between -s and -e)
+ *
+ * Cycle counts are converted to nanoseconds with the clock pairs in the
+ * drain headers.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "mmtrace.h"
+
+static const char *op_names[MMTRACE_NUM] = {
+    "malloc", "free", "realloc", "extend", "init"
+};
+
+/* Function prototypes */
+static mmtrace_event_t *load(char *path, long *n, double *ns_per_tick,
+                             uint64_t *dropped);
+static void summary(mmtrace_event_t *ev, long n, double ns_per_tick);
+static void slowest(mmtrace_event_t *ev, long n, double ns_per_tick,
+                    int k, int context);
+static void print_event(mmtrace_event_t *e, uint64_t tsc0,
+                        double ns_per_tick, char mark);
+static int cmp_tsc(const void *a, const void *b);
+static int cmp_u32(const void *a, const void *b);
+static void usage(void);
+static void app_error(char *msg);
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv)
+{
+    int c;
+    int k = 10;            /* slowest events to show (-k) */
+    int context = 3;       /* events shown around each of them (-c) */
+    int timeline = 0;      /* print the timeline (-t) */
+    double start = 0;      /* timeline window in microseconds (-s, -e) */
+    double end = -1;
+    mmtrace_event_t *ev;
+    double ns_per_tick, us;
+    uint64_t dropped;
+    long n, i;
+
+    while ((c = getopt(argc, argv, "k:c:ts:e:h")) != EOF) {
+        switch (c) {
+        case 'k': /* Number of slowest events */
+            k = atoi(optarg);
+            break;
+        case 'c': /* Context around each slow event */
+            context = atoi(optarg);
+            break;
+        case 't': /* Print the timeline */
+            timeline = 1;
+            break;
+        case 's': /* Timeline start */
+            start = atof(optarg);
+            break;
+        case 'e': /* Timeline end */
+            end = atof(optarg);
+            break;
+        case 'h': /* Print this message */
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind != argc - 1 || k < 0 || context < 0) {
+        usage();
+        exit(1);
+    }
+
+    ev = load(argv[optind], &n, &ns_per_tick, &dropped);
+    printf("%s: %ld events, %llu dropped, %.3f ns per tick\n\n",
+           argv[optind], n, (unsigned long long)dropped, ns_per_tick);
+    if (n == 0)
+        return 0;
+
+    summary(ev, n, ns_per_tick);
+    if (k > 0)
+        slowest(ev, n, ns_per_tick, k, context);
+
+    if (timeline) {
+        printf("Timeline:\n");
+        for (i = 0; i < n; i++) {
+            us = (ev[i].tsc - ev[0].tsc) * ns_per_tick / 1000;
+            if (us >= start && (end < 0 || us <= end))
+                print_event(&ev[i], ev[0].tsc, ns_per_tick, ' ');
+        }
+    }
+    free(ev);
+    return 0;
+}
+
+/*
+ * load - Read all drains of a trace file and sort the events by time
+ */
+static mmtrace_event_t *load(char *path, long *n, double *ns_per_tick,
+                             uint64_t *dropped)
+{
+    mmtrace_header_t hdr;
+    mmtrace_event_t *ev = NULL;
+    long cap = 0;
+    FILE *fp;
+
+    if ((fp = fopen(path, "r")) == NULL)
+        app_error("Could not open the trace file");
+    *n = 0;
+    *dropped = 0;
+    *ns_per_tick = 1;
+    while (fread(&hdr, sizeof(hdr), 1, fp) == 1) {
+        if (hdr.magic != MMTRACE_MAGIC)
+            app_error("Not an mmtrace file");
+        if (*n + (long)hdr.count > cap) {
+            cap = 2 * (*n + hdr.count);
+            if ((ev = realloc(ev, cap * sizeof(*ev))) == NULL)
+                app_error("Out of memory reading the trace");
+        }
+        if (fread(ev + *n, sizeof(*ev), hdr.count, fp) != hdr.count)
+            app_error("Truncated trace file");
+        *n += hdr.count;
+        *dropped += hdr.dropped;
+        /* the last drain spans the longest interval */
+        if (hdr.tsc1 > hdr.tsc0)
+            *ns_per_tick = (double)(hdr.ns1 - hdr.ns0) / (hdr.tsc1 - hdr.tsc0);
+    }
+    fclose(fp);
+    if (*n > 0)
+        qsort(ev, *n, sizeof(*ev), cmp_tsc);
+    return ev;
+}
+
+/*
+ * summary - Print latency and search length statistics per event type
+ */
+static void summary(mmtrace_event_t *ev, long n, double ns_per_tick)
+{
+    uint32_t *lat, *search;
+    long i, m;
+    int op;
+    double sum;
+
+    lat = malloc(n * sizeof(uint32_t));
+    search = malloc(n * sizeof(uint32_t));
+    if (lat == NULL || search == NULL)
+        app_error("Out of memory in summary");
+
+    printf("%-8s %10s %9s %9s %9s %9s %10s %8s %8s\n", "op", "count",
+           "mean ns", "p50 ns", "p99 ns", "p99.9 ns", "max ns",
+           "search", "max");
+    for (op = 0; op < MMTRACE_NUM; op++) {
+        sum = 0;
+        for (i = m = 0; i < n; i++) {
+            if (ev[i].op == op) {
+                lat[m] = ev[i].cycles;
+                search[m] = ev[i].search;
+                sum += ev[i].cycles;
+                m++;
+            }
+        }
+        if (m == 0)
+            continue;
+        qsort(lat, m, sizeof(uint32_t), cmp_u32);
+        qsort(search, m, sizeof(uint32_t), cmp_u32);
+        printf("%-8s %10ld %9.1f %9.1f %9.1f %9.1f %10.1f ", op_names[op], m,
+               sum / m * ns_per_tick, lat[m / 2] * ns_per_tick,
+               lat[m * 99 / 100] * ns_per_tick,
+               lat[m * 999 / 1000] * ns_per_tick, lat[m - 1] * ns_per_tick);
+        sum = 0;
+        for (i = 0; i < m; i++)
+            sum += search[i];
+        printf("%8.1f %8u\n", sum / m, search[m - 1]);
+    }
+    printf("\n");
+    free(lat);
+    free(search);
+}
+
+/*
+ * slowest - Print the k slowest events, each in the context of the
+ *    events its thread recorded around it. The slow event is marked '>'.
+ */
+static void slowest(mmtrace_event_t *ev, long n, double ns_per_tick,
+                    int k, int context)
+{
+    long *top, i, j, t;
+    int m = 0, found;
+
+    if ((top = malloc(k * sizeof(long))) == NULL)
+        app_error("Out of memory in slowest");
+
+    /* insertion into a sorted top-k list */
+    for (i = 0; i < n; i++) {
+        if (m == k && ev[i].cycles <= ev[top[m - 1]].cycles)
+            continue;
+        for (j = (m < k) ? m++ : m - 1; j > 0 && ev[top[j - 1]].cycles < ev[i].cycles; j--)
+            top[j] = top[j - 1];
+        top[j] = i;
+    }
+
+    printf("Slowest %d events:\n", m);
+    for (t = 0; t < m; t++) {
+        i = top[t];
+        /* walk back to the first context event of the same thread */
+        for (j = i, found = 0; j > 0 && found < context; )
+            if (ev[--j].tid == ev[i].tid)
+                found++;
+        for (found = -1; j < n && found < context; j++) {
+            if (ev[j].tid != ev[i].tid)
+                continue;
+            if (j >= i)
+                found++;
+            print_event(&ev[j], ev[0].tsc, ns_per_tick, j == i ? '>' : ' ');
+        }
+        printf("\n");
+    }
+    free(top);
+}
+
+/*
+ * print_event - One line of a timeline: time since the first event,
+ *    thread, type, bytes, address, latency and search length
+ */
+static void print_event(mmtrace_event_t *e, uint64_t tsc0,
+                        double ns_per_tick, char mark)
+{
+    printf("%c %12.3f us  t%-3u %-8s %10llu  %#14llx %10.1f ns  %6u\n",
+           mark, (e->tsc - tsc0) * ns_per_tick / 1000, e->tid,
+           e->op < MMTRACE_NUM ? op_names[e->op] : "?",
+           (unsigned long long)e->size, (unsigned long long)e->addr,
+           e->cycles * ns_per_tick, e->search);
+}
+
+/*
+ * cmp_tsc - qsort comparison by time, then thread
+ */
+static int cmp_tsc(const void *a, const void *b)
+{
+    const mmtrace_event_t *x = a, *y = b;
+
+    if (x->tsc != y->tsc)
+        return x->tsc < y->tsc ? -1 : 1;
+    return x->tid - y->tid;
+}
+
+/*
+ * cmp_u32 - qsort comparison of unsigned 32-bit integers
+ */
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mmtrace-read [-ht] [-k <n>] [-c <n>] [-s <us>] [-e <us>] <file.mmt>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-k <n>   Show the n slowest events (default 10).\n");
+    fprintf(stderr, "\t-c <n>   Events of the same thread shown before and after each (default 3).\n");
+    fprintf(stderr, "\t-t       Print the timeline of all events.\n");
+    fprintf(stderr, "\t-s <us>  Start the timeline at this time (microseconds).\n");
+    fprintf(stderr, "\t-e <us>  End the timeline at this time (microseconds).\n");
+    fprintf(stderr, "\t-h       Print this message.\n");
+}
+
+/*
+ * app_error - Report an arbitrary application error and exit
+ */
+static void app_error(char *msg)
+{
+    printf("%s\n", msg);
+    exit(1);
+}
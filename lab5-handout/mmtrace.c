@@ -0,0 +1,183 @@
+/*
+ * mmtrace.c - rings, draining and the drain thread for mmtrace.h
+ *
+ * Rings come straight from mmap and are never freed (a thread's ring
+ * outlives the thread so that its last events can still be drained).
+ * They are pushed onto a global list with a compare-and-swap, so a
+ * thread's first event costs one mmap and no lock. Drains are
+ * serialized with a spin flag; the writers never wait on it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "mmtrace.h"
+
+__thread mmtrace_ring_t *mmtrace_ring = NULL;
+int mmtrace_on = 0;
+
+static mmtrace_ring_t *rings = NULL;  /* every ring ever created */
+static int num_rings = 0;
+static char draining = 0;             /* spin flag held by mmtrace_drain */
+static uint64_t tsc0, ns0;            /* clock pair taken at startup */
+
+/* Drain thread state */
+static FILE *drain_fp = NULL;
+static pthread_t drain_thread;
+static int drain_interval;
+static int drain_stop;
+static uint64_t drain_written, drain_dropped;
+
+/* function prototypes */
+static uint64_t now_ns(void);
+static void *drain_loop(void *arg);
+
+/*
+ * clock_init - Take the first clock pair before main runs
+ */
+static void __attribute__((constructor)) clock_init(void)
+{
+    tsc0 = read_counter();
+    ns0 = now_ns();
+}
+
+/*
+ * mmtrace_ring_create - Map a ring for the calling thread and add it to
+ *    the list. Return NULL if there is no memory for it.
+ */
+mmtrace_ring_t *mmtrace_ring_create(void)
+{
+    mmtrace_ring_t *r;
+
+    r = mmap(NULL, sizeof(mmtrace_ring_t), PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (r == MAP_FAILED)
+        return NULL;
+    r->tid = __atomic_fetch_add(&num_rings, 1, __ATOMIC_RELAXED);
+    r->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&rings, &r->next, r, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+    mmtrace_ring = r;
+    return r;
+}
+
+/*
+ * mmtrace_enable - Turn recording on or off
+ */
+void mmtrace_enable(int on)
+{
+    __atomic_store_n(&mmtrace_on, on, __ATOMIC_RELAXED);
+}
+
+/*
+ * mmtrace_drain - Write a header and the events that every ring holds
+ *    right now. Events are written ring by ring, each ring in order;
+ *    mmtrace-read sorts them by time.
+ */
+uint64_t mmtrace_drain(FILE *fp)
+{
+    mmtrace_header_t hdr;
+    mmtrace_ring_t *r;
+    mmtrace_event_t e;
+    uint64_t i;
+
+    while (__atomic_test_and_set(&draining, __ATOMIC_ACQUIRE))
+        ;
+
+    /* Fix the set of events first, so the header can give their count */
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = MMTRACE_MAGIC;
+    for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+        r->snap = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        hdr.count += r->snap - r->tail;
+        hdr.dropped += __atomic_exchange_n(&r->dropped, 0, __ATOMIC_RELAXED);
+    }
+    hdr.tsc0 = tsc0;
+    hdr.ns0 = ns0;
+    hdr.tsc1 = read_counter();
+    hdr.ns1 = now_ns();
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+
+    for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+        for (i = r->tail; i != r->snap; i++) {
+            e = r->ev[i & (MMTRACE_EVENTS - 1)];
+            e.tid = r->tid;
+            fwrite(&e, sizeof(e), 1, fp);
+        }
+        /* hand the slots back to the writer */
+        __atomic_store_n(&r->tail, r->snap, __ATOMIC_RELEASE);
+    }
+    fflush(fp);
+
+    drain_dropped += hdr.dropped;
+    __atomic_clear(&draining, __ATOMIC_RELEASE);
+    return hdr.count;
+}
+
+/*
+ * mmtrace_start - Open path and start the drain thread
+ */
+int mmtrace_start(const char *path, int interval_ms)
+{
+    if ((drain_fp = fopen(path, "w")) == NULL)
+        return -1;
+    drain_interval = interval_ms;
+    drain_stop = 0;
+    drain_written = drain_dropped = 0;
+    if (pthread_create(&drain_thread, NULL, drain_loop, NULL) != 0) {
+        fclose(drain_fp);
+        drain_fp = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * mmtrace_stop - Stop the drain thread; it drains once more on its way out
+ */
+void mmtrace_stop(uint64_t *written, uint64_t *dropped)
+{
+    if (drain_fp == NULL)
+        return;
+    __atomic_store_n(&drain_stop, 1, __ATOMIC_RELAXED);
+    pthread_join(drain_thread, NULL);
+    fclose(drain_fp);
+    drain_fp = NULL;
+    if (written)
+        *written = drain_written;
+    if (dropped)
+        *dropped = drain_dropped;
+}
+
+/*
+ * drain_loop - Body of the drain thread
+ */
+static void *drain_loop(void *arg)
+{
+    struct timespec ts;
+    int stop;
+
+    ts.tv_sec = drain_interval / 1000;
+    ts.tv_nsec = (drain_interval % 1000) * 1000000L;
+    do {
+        nanosleep(&ts, NULL);
+        stop = __atomic_load_n(&drain_stop, __ATOMIC_RELAXED);
+        drain_written += mmtrace_drain(drain_fp);
+    } while (!stop);
+    return NULL;
+}
+
+/*
+ * now_ns - CLOCK_MONOTONIC in nanoseconds
+ */
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
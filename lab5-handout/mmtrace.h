@@ -0,0 +1,123 @@
+/*
+ * mmtrace.h - binary event tracing for the allocator's hot paths
+ *
+ * Built into mm.c with -DMM_TRACE (make mdriver.trace). Every thread that
+ * enters the allocator gets its own single-producer/single-consumer ring
+ * of fixed-size events; appending one is a few stores and a release
+ * store of the ring head, with no locks or system calls. Any thread may
+ * call mmtrace_drain to move the pending events of every ring to a file,
+ * or let mmtrace_start run a thread that does so periodically; the
+ * mmtrace-read tool turns the file into timelines and latency-spike
+ * reports. When a ring is full, new events are dropped and counted.
+ * Nothing is recorded until mmtrace_enable(1).
+ *
+ * File layout: one mmtrace_header_t, then mmtrace_event_t records. A file
+ * may hold several drains; each starts with its own header, whose
+ * clock pair lets the reader convert timestamps to nanoseconds.
+ */
+#ifndef __MMTRACE_H_
+#define __MMTRACE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "clock.h"
+
+#define MMTRACE_MAGIC  0x3145434152544d4dULL /* "MMTRACE1" */
+#define MMTRACE_EVENTS (1 << 18)           /* events per ring (power of two) */
+
+/* Event types */
+enum {
+    MMTRACE_MALLOC,   /* size requested, addr returned */
+    MMTRACE_FREE,     /* size of the block, addr freed */
+    MMTRACE_REALLOC,  /* size requested, addr returned */
+    MMTRACE_EXTEND,   /* heap grown by size bytes at addr */
+    MMTRACE_INIT,     /* heap reset by mm_init, starting at addr */
+    MMTRACE_NUM
+};
+
+/* One event; also the record layout of the trace file */
+typedef struct {
+    uint64_t tsc;     /* cycle counter when the call started */
+    uint64_t addr;    /* block address (see the event types) */
+    uint64_t size;    /* bytes (see the event types) */
+    uint32_t cycles;  /* duration of the call */
+    uint32_t search;  /* free blocks visited by find_fit */
+    uint16_t op;      /* MMTRACE_* */
+    uint16_t tid;     /* ring (thread) number, filled in when drained */
+    uint32_t pad;
+} mmtrace_event_t;
+
+/* Precedes the events of one drain */
+typedef struct {
+    uint64_t magic;   /* MMTRACE_MAGIC */
+    uint64_t count;   /* events that follow */
+    uint64_t dropped; /* events lost to full rings since the last drain */
+    uint64_t tsc0, ns0; /* cycle counter and CLOCK_MONOTONIC at startup */
+    uint64_t tsc1, ns1; /* ... and at this drain */
+} mmtrace_header_t;
+
+/* A thread's ring. head is written only by its thread, tail and snap
+   only by the drainer */
+typedef struct mmtrace_ring {
+    uint64_t head;                 /* next slot to write */
+    uint64_t tail;                 /* next slot to drain */
+    uint64_t snap;                 /* head as seen by the current drain */
+    uint64_t dropped;              /* events lost because the ring was full */
+    uint16_t tid;                  /* ring number */
+    struct mmtrace_ring *next;     /* list of all rings */
+    mmtrace_event_t ev[MMTRACE_EVENTS];
+} mmtrace_ring_t;
+
+extern __thread mmtrace_ring_t *mmtrace_ring;
+extern int mmtrace_on;
+
+/* Create and register the calling thread's ring */
+mmtrace_ring_t *mmtrace_ring_create(void);
+
+/* Turn recording on or off for all threads */
+void mmtrace_enable(int on);
+
+/* Append the pending events of every ring to fp, preceded by a header.
+   Return the number of events written */
+uint64_t mmtrace_drain(FILE *fp);
+
+/* Start a thread that drains to path every interval_ms milliseconds.
+   Return 0, or -1 if the file or thread could not be created */
+int mmtrace_start(const char *path, int interval_ms);
+
+/* Stop the drain thread after a last drain, and close the file. Return
+   the total number of events written and dropped */
+void mmtrace_stop(uint64_t *written, uint64_t *dropped);
+
+/*
+ * mmtrace_event - Append one event to the calling thread's ring
+ */
+static inline void mmtrace_event(int op, uint64_t start, void *addr,
+                                 uint64_t size, uint32_t search)
+{
+    mmtrace_ring_t *r = mmtrace_ring;
+    mmtrace_event_t *e;
+    uint64_t head;
+
+    if (!__atomic_load_n(&mmtrace_on, __ATOMIC_RELAXED))
+        return;
+    if (r == NULL && (r = mmtrace_ring_create()) == NULL)
+        return;
+    head = r->head;
+    if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == MMTRACE_EVENTS) {
+        __atomic_fetch_add(&r->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    e = &r->ev[head & (MMTRACE_EVENTS - 1)];
+    e->tsc = start;
+    e->addr = (uint64_t)addr;
+    e->size = size;
+    e->cycles = (uint32_t)(read_counter() - start);
+    e->search = search;
+    e->op = op;
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+#endif /* __MMTRACE_H_ */
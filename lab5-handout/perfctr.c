@@ -0,0 +1,125 @@
+/*
+ * perfctr.c - hardware performance counters via perf_event_open
+ *
+ * Counters count user-space events of the calling thread only, so the
+ * numbers cover the allocator and the driver loop around it but not the
+ * kernel (page faults from mem_sbrk'd memory show up as dTLB misses, not
+ * as kernel time).
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perfctr.h"
+
+char *perfctr_names[PERFCTR_NUM] = {
+    "instrs", "cycles", "L1d-miss", "LLC-miss", "dTLB-miss", "br-miss"
+};
+
+#define CACHE_EVENT(cache, op, result) \
+    ((cache) | ((op) << 8) | ((result) << 16))
+
+/* perf event type and config for each counter */
+static struct {
+    unsigned type;
+    unsigned long long config;
+} events[PERFCTR_NUM] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D,
+                                     PERF_COUNT_HW_CACHE_OP_READ,
+                                     PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_LL,
+                                     PERF_COUNT_HW_CACHE_OP_READ,
+                                     PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB,
+                                     PERF_COUNT_HW_CACHE_OP_READ,
+                                     PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+static int fds[PERFCTR_NUM] = {-1, -1, -1, -1, -1, -1};
+
+/*
+ * perfctr_init - open every counter we can
+ */
+int perfctr_init(void)
+{
+    struct perf_event_attr attr;
+    int i, n = 0, err = 0;
+
+    for (i = 0; i < PERFCTR_NUM; i++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+            PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fds[i] < 0)
+            err = errno;
+        else
+            n++;
+    }
+
+    if (n < PERFCTR_NUM)
+        fprintf(stderr, "perfctr: %d of %d counters unavailable (%s)\n",
+                PERFCTR_NUM - n, PERFCTR_NUM, strerror(err));
+    return n;
+}
+
+/*
+ * perfctr_deinit - close the counters
+ */
+void perfctr_deinit(void)
+{
+    int i;
+
+    for (i = 0; i < PERFCTR_NUM; i++) {
+        if (fds[i] >= 0)
+            close(fds[i]);
+        fds[i] = -1;
+    }
+}
+
+/*
+ * perfctr_measure - run f(argp) once under the counters
+ */
+void perfctr_measure(perfctr_test_funct f, void *argp, perfctr_t *res)
+{
+    unsigned long long buf[3]; /* value, time enabled, time running */
+    int i;
+
+    for (i = 0; i < PERFCTR_NUM; i++) {
+        if (fds[i] >= 0) {
+            ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    f(argp);
+
+    for (i = 0; i < PERFCTR_NUM; i++) {
+        if (fds[i] >= 0)
+            ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+    }
+
+    for (i = 0; i < PERFCTR_NUM; i++) {
+        res->valid[i] = 0;
+        res->count[i] = 0;
+        if (fds[i] < 0 || read(fds[i], buf, sizeof(buf)) != sizeof(buf))
+            continue;
+        if (buf[2] == 0) /* never scheduled onto the PMU */
+            continue;
+        res->valid[i] = 1;
+        res->count[i] = (double)buf[0] * ((double)buf[1] / (double)buf[2]);
+    }
+}
@@ -0,0 +1,35 @@
+/*
+ * perfctr.h - hardware performance counters via perf_event_open
+ *
+ * Each counter is opened on its own, so a machine (or VM, or container)
+ * that lacks some events still reports the rest. Counters that could not
+ * be opened are marked invalid rather than treated as errors.
+ */
+enum {
+    PERFCTR_INSTRUCTIONS,
+    PERFCTR_CYCLES,
+    PERFCTR_L1D_MISSES,
+    PERFCTR_LLC_MISSES,
+    PERFCTR_DTLB_MISSES,
+    PERFCTR_BRANCH_MISSES,
+    PERFCTR_NUM
+};
+
+typedef struct {
+    int valid[PERFCTR_NUM];     /* was this counter measured? */
+    double count[PERFCTR_NUM];  /* event counts, scaled for multiplexing */
+} perfctr_t;
+
+/* Short names for the counters, indexed like perfctr_t.count */
+extern char *perfctr_names[PERFCTR_NUM];
+
+/* Open the counters for this process. Returns the number of counters
+   that are available (0 if perf events are not usable at all) */
+int perfctr_init(void);
+
+/* Close the counters */
+void perfctr_deinit(void);
+
+/* Run f(argp) once with the counters enabled and store the counts in res */
+typedef void (*perfctr_test_funct)(void *);
+void perfctr_measure(perfctr_test_funct f, void *argp, perfctr_t *res);
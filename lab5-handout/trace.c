@@ -0,0 +1,129 @@
+/*
+ * trace.c - read .rep trace files into memory
+ *
+ * Shared by mdriver and the trace tools (traceinfo).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "trace.h"
+
+#define MAXLINE     1024 /* max string size */
+
+extern int verbose; /* -v option of the program using this module */
+
+static char msg[2 * MAXLINE]; /* for composing error messages (with a path) */
+
+/*
+ * unix_error - Report a Unix-style error and exit
+ */
+static void unix_error(char *msg)
+{
+    printf("%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+/*
+ * read_trace - read a trace file and store it in memory
+ */
+trace_t *read_trace(char *tracedir, char *filename)
+{
+    FILE *tracefile;
+    trace_t *trace;
+    char type[MAXLINE];
+    char path[MAXLINE];
+    long index;
+    size_t size;
+    long max_index = 0;
+    long op_index;
+    int scan_result = 1;
+
+    if (verbose > 1)
+        printf("Reading tracefile: %s\n", filename);
+
+    /* Allocate the trace record */
+    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
+        unix_error("malloc 1 failed in read_trance");
+
+    /* Read the trace file header */
+    if (snprintf(path, sizeof(path), "%s%s", tracedir, filename) >= (int)sizeof(path)) {
+        printf("Tracefile path too long: %s%s\n", tracedir, filename);
+        exit(1);
+    }
+    if ((tracefile = fopen(path, "r")) == NULL) {
+        snprintf(msg, sizeof(msg), "Could not open %s in read_trace", path);
+        unix_error(msg);
+    }
+    scan_result &= fscanf(tracefile, "%zu", &(trace->sugg_heapsize)); /* not used */
+    scan_result &= fscanf(tracefile, "%ld", &(trace->num_ids));
+    scan_result &= fscanf(tracefile, "%ld", &(trace->num_ops));
+    scan_result &= fscanf(tracefile, "%d", &(trace->weight));        /* not used */
+
+    /* We'll store each request line in the trace in this array */
+    if ((trace->ops =
+         (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+        unix_error("malloc 2 failed in read_trace");
+
+    /* We'll keep an array of pointers to the allocated blocks here... */
+    if ((trace->blocks =
+         (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+        unix_error("malloc 3 failed in read_trace");
+
+    /* ... along with the corresponding byte sizes of each block */
+    if ((trace->block_sizes =
+         (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+        unix_error("malloc 4 failed in read_trace");
+
+    /* read every request line in the trace file */
+    index = 0;
+    op_index = 0;
+    while (fscanf(tracefile, "%1023s", type) != EOF) { /* MAXLINE - 1 */
+        switch(type[0]) {
+        case 'a':
+            scan_result &= fscanf(tracefile, "%ld %zu", &index, &size);
+            trace->ops[op_index].type = ALLOC;
+            trace->ops[op_index].index = index;
+            trace->ops[op_index].size = size;
+            max_index = (index > max_index) ? index : max_index;
+            break;
+        case 'r':
+            scan_result &= fscanf(tracefile, "%ld %zu", &index, &size);
+            trace->ops[op_index].type = REALLOC;
+            trace->ops[op_index].index = index;
+            trace->ops[op_index].size = size;
+            max_index = (index > max_index) ? index : max_index;
+            break;
+        case 'f':
+            scan_result &= fscanf(tracefile, "%ld", &index);
+            trace->ops[op_index].type = FREE;
+            trace->ops[op_index].index = index;
+            break;
+        default:
+            printf("Bogus type character (%c) in tracefile %s\n",
+                   type[0], path);
+            exit(1);
+        }
+        op_index++;
+
+    }
+    fclose(tracefile);
+    assert(max_index == trace->num_ids - 1);
+    assert(trace->num_ops == op_index);
+
+    return trace;
+}
+
+/*
+ * free_trace - Free the trace record and the three arrays it points
+ *              to, all of which were allocated in read_trace().
+ */
+void free_trace(trace_t *trace)
+{
+    free(trace->ops);         /* free the three arrays... */
+    free(trace->blocks);
+    free(trace->block_sizes);
+    free(trace);              /* and the trace record itself... */
+}
@@ -0,0 +1,36 @@
+/*
+ * trace.h - in-memory form of the .rep trace files used by mdriver
+ * and the trace tools
+ */
+#ifndef __TRACE_H_
+#define __TRACE_H_
+
+#include <stddef.h>
+
+#define HDRLINES       4 /* number of header lines in a trace file */
+
+/* Characterizes a single trace operation (allocator request) */
+typedef struct {
+    enum {ALLOC, FREE, REALLOC} type; /* type of request */
+    long index;                       /* index for free() to use later */
+    size_t size;                      /* byte size of alloc request */
+} traceop_t;
+
+/* Holds the information for one trace file*/
+typedef struct {
+    size_t sugg_heapsize; /* suggested heap size (unused) */
+    long num_ids;        /* number of alloc ids */
+    long num_ops;        /* number of distinct requests */
+    int weight;          /* weight for this trace (unused) */
+    traceop_t *ops;      /* array of requests */
+    char **blocks;       /* array of ptrs returned by malloc */
+    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+} trace_t;
+
+/* Read tracedir/filename into memory; exits on any error */
+trace_t *read_trace(char *tracedir, char *filename);
+
+/* Free a trace returned by read_trace */
+void free_trace(trace_t *trace);
+
+#endif /* __TRACE_H_ */
@@ -0,0 +1,456 @@
+/*
+ * traceinfo.c - Workload profile of .rep trace files
+ *
+ * Reads traces with the same read_trace as mdriver and reports, for each:
+ *
+ *   - request sizes: power-of-two histogram and percentiles
+ *   - block lifetimes in ops (alloc to free, across reallocs)
+ *   - the peak live set, in bytes and in blocks
+ *   - alloc/free interleaving: run lengths, and how often a free
+ *     releases the youngest (LIFO) or oldest (FIFO) live block
+ *   - realloc chains: length and growth per block
+ *   - a set of size classes that minimizes internal fragmentation for
+ *     the trace's small requests, next to plain power-of-two classes
+ *
+ * The size classes come from a dynamic program over the distinct
+ * ALIGNMENT-rounded request sizes: with k classes, best[k][i] is the
+ * least waste for the i smallest sizes when the largest of them is
+ * itself a class boundary.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "trace.h"
+#include "lathist.h"
+#include "config.h"
+
+/* Misc */
+#define LOG_BUCKETS  64      /* power-of-two histogram buckets */
+#define BAR_WIDTH    40      /* width of the histogram bars */
+#define MAXCLASSES   64      /* max number of suggested size classes */
+#define MAXLIMIT     (1<<16) /* largest -t, keeps the DP small */
+
+/* Round a request up to the allocator's alignment */
+#define ALIGN(size) (((size) + (ALIGNMENT - 1)) & ~(size_t)(ALIGNMENT - 1))
+
+/* Power-of-two histogram: bucket k counts values in [2^k, 2^(k+1)) */
+typedef struct {
+    unsigned long long count[LOG_BUCKETS];
+    double bytes[LOG_BUCKETS];   /* sum of the values in each bucket */
+    unsigned long long n;
+} loghist_t;
+
+/* One distinct (rounded) request size and its demand */
+typedef struct {
+    size_t size;     /* ALIGNMENT-rounded size */
+    double count;    /* number of requests that round to it */
+    double raw;      /* sum of their unrounded sizes */
+} sizebin_t;
+
+int verbose = 0; /* needed by read_trace */
+
+/* Function prototypes */
+static void analyze(char *path, int nclasses, size_t limit);
+static void loghist_add(loghist_t *h, unsigned long long val);
+static void print_loghist(loghist_t *h, char *unit);
+static void suggest_classes(trace_t *trace, int nclasses, size_t limit);
+static double pow2_waste(sizebin_t *bins, int n, int *nclasses);
+static void usage(void);
+static void app_error(char *msg);
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv)
+{
+    int c, i;
+    int nclasses = 8;    /* number of size classes to suggest (-k) */
+    size_t limit = 4096; /* largest request covered by the classes (-t) */
+
+    while ((c = getopt(argc, argv, "k:t:h")) != EOF) {
+        switch (c) {
+        case 'k': /* Number of size classes */
+            nclasses = atoi(optarg);
+            if (nclasses < 1 || nclasses > MAXCLASSES)
+                app_error("-k must be between 1 and 64");
+            break;
+        case 't': /* Size class threshold */
+            limit = strtoul(optarg, NULL, 0);
+            if (limit < ALIGNMENT || limit > MAXLIMIT)
+                app_error("-t must be between ALIGNMENT and 65536");
+            break;
+        case 'h': /* Print this message */
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind == argc) {
+        usage();
+        exit(1);
+    }
+
+    for (i = optind; i < argc; i++)
+        analyze(argv[i], nclasses, limit);
+    return 0;
+}
+
+/*
+ * analyze - Print the full profile of one trace file
+ */
+static void analyze(char *path, int nclasses, size_t limit)
+{
+    trace_t *trace;
+    traceop_t *op;
+    long i, id, *born, *reallocs, *prev, *next;
+    long head = -1, tail = -1;  /* oldest and youngest live blocks */
+    size_t *first_size;
+    loghist_t sizes, lives;
+    lathist_t size_pct, life_pct, chain_pct;
+    unsigned long long allocs = 0, frees = 0, reallocs_total = 0;
+    unsigned long long lifo = 0, fifo = 0, grows = 0, shrinks = 0;
+    unsigned long long alloc_runs = 0, free_runs = 0, chains = 0;
+    double live = 0, peak = 0, growth = 0, bytes = 0;
+    long live_blocks = 0, peak_blocks = 0, peak_op = 0;
+    int last = -1;              /* type of the previous alloc or free */
+
+    trace = read_trace("", path);
+
+    if ((born = malloc(trace->num_ids * sizeof(long))) == NULL ||
+        (reallocs = calloc(trace->num_ids, sizeof(long))) == NULL ||
+        (prev = malloc(trace->num_ids * sizeof(long))) == NULL ||
+        (next = malloc(trace->num_ids * sizeof(long))) == NULL ||
+        (first_size = malloc(trace->num_ids * sizeof(size_t))) == NULL)
+        app_error("out of memory");
+
+    memset(&sizes, 0, sizeof(sizes));
+    memset(&lives, 0, sizeof(lives));
+    lathist_reset(&size_pct);
+    lathist_reset(&life_pct);
+    lathist_reset(&chain_pct);
+
+    for (i = 0; i < trace->num_ops; i++) {
+        op = &trace->ops[i];
+        id = op->index;
+
+        switch (op->type) {
+        case ALLOC:
+            allocs++;
+            bytes += op->size;
+            loghist_add(&sizes, op->size);
+            lathist_add(&size_pct, op->size);
+            born[id] = i;
+            first_size[id] = op->size;
+            trace->block_sizes[id] = op->size;
+            live += op->size;
+            live_blocks++;
+
+            /* Append to the live list, which is kept in allocation order */
+            prev[id] = tail;
+            next[id] = -1;
+            if (tail >= 0)
+                next[tail] = id;
+            else
+                head = id;
+            tail = id;
+
+            if (last != ALLOC)
+                alloc_runs++;
+            last = ALLOC;
+            break;
+
+        case REALLOC:
+            reallocs_total++;
+            if (reallocs[id]++ == 0)
+                chains++;
+            if (op->size > trace->block_sizes[id])
+                grows++;
+            else if (op->size < trace->block_sizes[id])
+                shrinks++;
+            bytes += op->size;
+            loghist_add(&sizes, op->size);
+            lathist_add(&size_pct, op->size);
+            live += (double)op->size - trace->block_sizes[id];
+            trace->block_sizes[id] = op->size;
+            break;
+
+        case FREE:
+            frees++;
+            loghist_add(&lives, i - born[id]);
+            lathist_add(&life_pct, i - born[id]);
+            live -= trace->block_sizes[id];
+            live_blocks--;
+
+            if (id == tail)
+                lifo++;
+            if (id == head)
+                fifo++;
+            if (prev[id] >= 0)
+                next[prev[id]] = next[id];
+            else
+                head = next[id];
+            if (next[id] >= 0)
+                prev[next[id]] = prev[id];
+            else
+                tail = prev[id];
+
+            if (reallocs[id]) {
+                lathist_add(&chain_pct, reallocs[id]);
+                if (first_size[id] > 0)
+                    growth += (double)trace->block_sizes[id] / first_size[id];
+            }
+
+            if (last != FREE)
+                free_runs++;
+            last = FREE;
+            break;
+        }
+
+        if (live > peak) {
+            peak = live;
+            peak_op = i;
+        }
+        if (live_blocks > peak_blocks)
+            peak_blocks = live_blocks;
+    }
+
+    printf("=== %s\n", path);
+    printf("ops %ld (%llu alloc, %llu free, %llu realloc), ids %ld\n",
+           trace->num_ops, allocs, frees, reallocs_total, trace->num_ids);
+    if (live_blocks > 0)
+        printf("warning: %ld blocks are never freed\n", live_blocks);
+
+    printf("\nRequest sizes (bytes), %.0f bytes requested:\n", bytes);
+    printf("  p50 %llu  p90 %llu  p99 %llu  max %llu\n",
+           lathist_percentile(&size_pct, 50), lathist_percentile(&size_pct, 90),
+           lathist_percentile(&size_pct, 99), size_pct.max);
+    print_loghist(&sizes, "bytes");
+
+    printf("\nLifetimes (ops from alloc to free):\n");
+    if (life_pct.n > 0) {
+        printf("  mean %.1f  p50 %llu  p90 %llu  p99 %llu  max %llu\n",
+               life_pct.sum / life_pct.n,
+               lathist_percentile(&life_pct, 50), lathist_percentile(&life_pct, 90),
+               lathist_percentile(&life_pct, 99), life_pct.max);
+        print_loghist(&lives, "ops");
+    }
+
+    printf("\nPeak live set: %.0f bytes at op %ld, %ld blocks at most\n",
+           peak, peak_op, peak_blocks);
+
+    printf("\nInterleaving:\n");
+    printf("  mean alloc run %.1f ops, mean free run %.1f ops\n",
+           alloc_runs ? (double)allocs / alloc_runs : 0.0,
+           free_runs ? (double)frees / free_runs : 0.0);
+    printf("  frees of the youngest live block (LIFO) %.1f%%, of the oldest (FIFO) %.1f%%\n",
+           frees ? 100.0 * lifo / frees : 0.0, frees ? 100.0 * fifo / frees : 0.0);
+
+    printf("\nRealloc chains: %llu blocks reallocated", chains);
+    if (chains > 0)
+        printf(", length mean %.1f max %llu; %llu grow, %llu shrink; "
+               "final/first size %.2fx",
+               chain_pct.n ? chain_pct.sum / chain_pct.n : 0.0, chain_pct.max,
+               grows, shrinks, chain_pct.n ? growth / chain_pct.n : 0.0);
+    printf("\n");
+
+    suggest_classes(trace, nclasses, limit);
+    printf("\n");
+
+    free(born);
+    free(reallocs);
+    free(prev);
+    free(next);
+    free(first_size);
+    free_trace(trace);
+}
+
+/*
+ * suggest_classes - Print the nclasses size classes that waste the least
+ *    space on the trace's requests of at most limit bytes
+ */
+static void suggest_classes(trace_t *trace, int nclasses, size_t limit)
+{
+    sizebin_t *bins;
+    double *cnt, *raw, *best, *prevbest, cost, total_raw, waste;
+    int *cut, n = 0, i, j, k, m, top, nbins = ALIGN(limit) / ALIGNMENT;
+    int bounds[MAXCLASSES], npow2;
+    size_t size;
+
+    if ((bins = calloc(nbins + 1, sizeof(sizebin_t))) == NULL)
+        app_error("out of memory");
+
+    /* Demand at every aligned size up to limit */
+    for (i = 0; i < trace->num_ops; i++) {
+        if (trace->ops[i].type == FREE || trace->ops[i].size > limit)
+            continue;
+        size = ALIGN(trace->ops[i].size);
+        if (size == 0)
+            size = ALIGNMENT;
+        bins[size / ALIGNMENT].size = size;
+        bins[size / ALIGNMENT].count++;
+        bins[size / ALIGNMENT].raw += trace->ops[i].size;
+    }
+    /* Squeeze out the empty sizes; the bins stay in increasing order */
+    for (i = 0; i <= nbins; i++)
+        if (bins[i].count > 0)
+            bins[n++] = bins[i];
+
+    printf("\nSuggested size classes for requests <= %zu bytes:\n", limit);
+    if (n == 0) {
+        printf("  (no requests in range)\n");
+        free(bins);
+        return;
+    }
+    if (nclasses > n)
+        nclasses = n;
+
+    /* Prefix sums, so the waste of any run of bins costs O(1) */
+    if ((cnt = calloc(n + 1, sizeof(double))) == NULL ||
+        (raw = calloc(n + 1, sizeof(double))) == NULL ||
+        (best = malloc((n + 1) * sizeof(double))) == NULL ||
+        (prevbest = malloc((n + 1) * sizeof(double))) == NULL ||
+        (cut = malloc((size_t)(nclasses + 1) * (n + 1) * sizeof(int))) == NULL)
+        app_error("out of memory");
+    for (i = 0; i < n; i++) {
+        cnt[i + 1] = cnt[i] + bins[i].count;
+        raw[i + 1] = raw[i] + bins[i].raw;
+    }
+    total_raw = raw[n];
+
+    /* best[i]: least waste for bins 0..i-1 using k classes, the largest
+       of which is bins[i-1].size; cut[k][i] is where that class starts */
+    for (i = 0; i <= n; i++)
+        prevbest[i] = (i == 0) ? 0 : -1;
+    for (k = 1; k <= nclasses; k++) {
+        for (i = 0; i <= n; i++) {
+            best[i] = -1;
+            cut[k * (n + 1) + i] = 0;
+            for (j = k - 1; j < i; j++) {
+                if (prevbest[j] < 0)
+                    continue;
+                cost = prevbest[j] + bins[i - 1].size * (cnt[i] - cnt[j]) -
+                    (raw[i] - raw[j]);
+                if (best[i] < 0 || cost < best[i]) {
+                    best[i] = cost;
+                    cut[k * (n + 1) + i] = j;
+                }
+            }
+        }
+        memcpy(prevbest, best, (n + 1) * sizeof(double));
+    }
+    waste = prevbest[n];
+
+    /* Walk the cuts back to recover the class boundaries */
+    for (k = nclasses, i = n; k > 0; k--) {
+        bounds[k - 1] = i - 1;
+        i = cut[k * (n + 1) + i];
+    }
+
+    printf("  %8s%12s%14s%8s\n", "class", "requests", "waste bytes", "waste%");
+    for (k = 0, j = 0; k < nclasses; k++) {
+        top = bounds[k];
+        cost = 0;
+        for (m = j; m <= top; m++)
+            cost += bins[top].size * bins[m].count - bins[m].raw;
+        printf("  %8zu%12.0f%14.0f%7.1f%%\n", bins[top].size,
+               cnt[top + 1] - cnt[j], cost,
+               (raw[top + 1] - raw[j]) > 0 ? 100.0 * cost / (raw[top + 1] - raw[j]) : 0.0);
+        j = top + 1;
+    }
+    cost = pow2_waste(bins, n, &npow2);
+    printf("  internal fragmentation %.1f%% with these %d classes, %.1f%% with "
+           "%d power-of-two classes\n", 100.0 * waste / total_raw, nclasses,
+           100.0 * cost / total_raw, npow2);
+
+    free(bins);
+    free(cnt);
+    free(raw);
+    free(best);
+    free(prevbest);
+    free(cut);
+}
+
+/*
+ * pow2_waste - Bytes wasted by rounding every bin up to a power of two;
+ *    *nclasses is set to the number of powers of two that get used
+ */
+static double pow2_waste(sizebin_t *bins, int n, int *nclasses)
+{
+    double waste = 0;
+    size_t class, last = 0;
+    int i;
+
+    *nclasses = 0;
+    for (i = 0; i < n; i++) {
+        for (class = ALIGNMENT; class < bins[i].size; class <<= 1)
+            ;
+        waste += class * bins[i].count - bins[i].raw;
+        if (class != last)
+            (*nclasses)++;
+        last = class;
+    }
+    return waste;
+}
+
+/*
+ * loghist_add - Count val in its power-of-two bucket (0 goes in bucket 0)
+ */
+static void loghist_add(loghist_t *h, unsigned long long val)
+{
+    int k = val ? 63 - __builtin_clzll(val) : 0;
+
+    h->count[k]++;
+    h->bytes[k] += val;
+    h->n++;
+}
+
+/*
+ * print_loghist - Print the non-empty buckets of a histogram with bars
+ */
+static void print_loghist(loghist_t *h, char *unit)
+{
+    int k, lo = LOG_BUCKETS, hi = -1, bar;
+    unsigned long long most = 0;
+
+    for (k = 0; k < LOG_BUCKETS; k++) {
+        if (h->count[k] == 0)
+            continue;
+        lo = (k < lo) ? k : lo;
+        hi = k;
+        most = (h->count[k] > most) ? h->count[k] : most;
+    }
+
+    printf("  %21s%10s%8s\n", unit, "count", "%");
+    for (k = lo; k <= hi; k++) {
+        bar = most ? (int)(BAR_WIDTH * h->count[k] / most) : 0;
+        printf("  [%8llu, %8llu)%10llu%7.1f%% %.*s\n",
+               k ? 1ULL << k : 0ULL, 1ULL << (k + 1), h->count[k],
+               100.0 * h->count[k] / h->n, bar,
+               "########################################");
+    }
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: traceinfo [-h] [-k <classes>] [-t <bytes>] <trace.rep>...\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-k <n>      Number of size classes to suggest (default 8).\n");
+    fprintf(stderr, "\t-t <bytes>  Largest request served by size classes (default 4096).\n");
+    fprintf(stderr, "\t-h          Print this message.\n");
+}
+
+/*
+ * app_error - Report an arbitrary application error and exit
+ */
+static void app_error(char *msg)
+{
+    printf("%s\n", msg);
+    exit(1);
+}